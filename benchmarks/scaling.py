@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""插桩工具的规模测试：生成嵌套层数和访问数逐步增大的内核，统计 MemProfMT 的运行时间。
+
+每访问耗时应随规模基本保持不变；若随嵌套层数增长，说明访问点的分类又退化为沿父节点链查找。
+"""
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+def generate_kernel(depth: int, accesses: int) -> str:
+    """生成 depth 层交替的 for/if 嵌套，最内层及各层条件中共有约 accesses 次数组访问"""
+    lines = [f"#define N {depth + 1}", "", "void kernel(float a[N][64], float b[64], int n) {", "    float s = 0;"]
+    indent = "    "
+    for level in range(depth):
+        var = f"i{level}"
+        if level % 2 == 0:
+            lines.append(f"{indent}for (int {var} = 0; {var} < n && b[{var} % 64] > 0; {var}++) {{")
+        else:
+            lines.append(f"{indent}if (b[{level} % 64] > a[{level}][0]) {{")
+        indent += "    "
+    for k in range(max(accesses - depth, 1)):
+        lines.append(f"{indent}s += a[{k % (depth + 1)}][{k % 64}] * b[{(k * 7) % 64}];")
+    for _ in range(depth):
+        indent = indent[:-4]
+        lines.append(f"{indent}}}")
+    lines.append("    b[0] = s;")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+def run_case(tool: str, workdir: str, depth: int, accesses: int) -> float:
+    source = os.path.join(workdir, f"kernel_d{depth}_n{accesses}.c")
+    with open(source, 'w') as f:
+        f.write(generate_kernel(depth, accesses))
+    start = time.perf_counter()
+    subprocess.run([tool, source, "-o", source + ".out", "--", "-std=c99"],
+                   check=True, stdout=subprocess.DEVNULL)
+    return time.perf_counter() - start
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--tool', default='bin/MemProfMT', help='MemProfMT 可执行文件')
+    parser.add_argument('--depths', default='4,16,64,128', help='逗号分隔的嵌套层数')
+    parser.add_argument('--accesses', default='1000,4000,16000', help='逗号分隔的访问数')
+    args = parser.parse_args()
+
+    if not os.path.exists(args.tool):
+        print(f"错误：找不到 {args.tool}，请先运行 make", file=sys.stderr)
+        sys.exit(1)
+
+    print(f"{'depth':>6} {'accesses':>9} {'seconds':>9} {'us/access':>10}")
+    with tempfile.TemporaryDirectory() as workdir:
+        for depth in map(int, args.depths.split(',')):
+            for accesses in map(int, args.accesses.split(',')):
+                seconds = run_case(args.tool, workdir, depth, accesses)
+                print(f"{depth:>6} {accesses:>9} {seconds:>9.2f} {seconds * 1e6 / accesses:>10.1f}")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,31 @@
+#ifndef AFFINE_ANALYSIS_H
+#define AFFINE_ANALYSIS_H
+
+#include "clang/AST/AST.h"
+#include "clang/AST/ASTContext.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// 规范计数循环 for (i = lo; i < hi; i += s) 中的仿射数组访问 a[c*i + d]，
+// 多维数组 a[c0*i + d0][c1*i + d1] 的每一维都是迭代变量的仿射函数
+struct AffineAccess
+{
+    const clang::ForStmt *loop = nullptr;  // 访问所在的循环
+    std::vector<std::string> firstIndices; // 第一次迭代时各维的下标表达式，由外向内
+    std::vector<int64_t> indexSteps;       // 相邻两次迭代之间各维下标的变化（c*s）
+    int64_t stride = 0;                    // 相邻两次迭代之间的元素步长
+    std::string tripCount;                 // 循环迭代次数表达式，在循环之前求值
+};
+
+// 判断数组下标访问是否为最内层规范循环中无条件执行的仿射访问。
+// Ancestors 为访问的祖先语句，由内向外至少到最内层循环的父语句为止，空指针表示声明边界
+// （如变量的初始化表达式），由插桩遍历时维护的语句上下文栈给出，不需要查找父节点。
+// 循环边界、步长和下标偏移都必须在循环中保持不变，否则返回空；
+// 多维数组除最外层以外各维的长度必须是常量
+std::optional<AffineAccess> analyzeAffineAccess(const clang::ArraySubscriptExpr *ASE,
+                                                const std::vector<const clang::Stmt *> &Ancestors,
+                                                clang::ASTContext &ctx);
+
+#endif // AFFINE_ANALYSIS_H
@@ -8,6 +8,7 @@
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Basic/SourceManager.h"
 #include "llvm/Support/CommandLine.h"
+#include "../runtime/MemoryProfiler.h"
 #include <memory>
 #include <string>
 
@@ -20,5 +21,34 @@ extern cl::OptionCategory ToolCategory;
 
 extern cl::opt<std::string> OutputFilename;
 extern cl::list<std::string> TargetFunctions;
+extern cl::opt<ProfilerBackend> Backend;
+extern cl::opt<unsigned> SamplePeriod;
+extern cl::opt<unsigned> SampleBurst;
+extern cl::opt<bool> AffineSummary;
+extern cl::opt<unsigned> BatchSize;
+extern cl::opt<OutputFormat> ProfileOutputFormat;
+extern cl::opt<unsigned> ReduceThreads;
+extern cl::opt<bool> ReuseDistance;
+extern cl::opt<bool> HeatMap;
+extern cl::opt<unsigned> PhaseWindow;
+extern cl::opt<bool> Timing;
+extern cl::opt<bool> LoadStore;
+extern cl::opt<bool> RunLengths;
+extern cl::opt<bool> DimStrides;
+extern cl::opt<bool> LoopSites;
+extern cl::opt<bool> Sharing;
+extern cl::opt<bool> CompactProfile;
+extern cl::opt<bool> Accumulate;
+extern cl::list<std::string> ReportFunctions;
+extern cl::opt<bool> RuntimeLibrary;
+extern cl::opt<std::string> EmitRuntime;
+extern cl::opt<unsigned> Jobs;
+extern cl::opt<std::string> CacheDir;
+
+// 根据命令行选项构造运行时代码生成配置
+ProfilerConfig getProfilerConfig();
+
+// 影响插桩结果的全部选项，用作插桩缓存键的一部分；新增插桩选项时需要同步加入
+std::string getOptionsFingerprint();
 
 #endif //COMMANDLINEOPTIONS_H
\ No newline at end of file
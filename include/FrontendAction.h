@@ -9,6 +9,8 @@
 #include "clang/Tooling/Tooling.h"
 #include "clang/Rewrite/Core/Rewriter.h"
 #include "clang/Frontend/FrontendAction.h"
+#include "llvm/Support/raw_ostream.h"
+#include "../runtime/MemoryProfiler.h"
 #include <memory>
 
 using namespace clang;
@@ -40,10 +42,19 @@ private:
     std::vector<std::string>& includes;  // 直接引用外部的 includes
 };
 
-class InstrumentationFrontendAction : public clang::ASTFrontendAction
+// 插桩结果的输出路径：outputFilename 非空时直接使用，否则为源文件旁的 mem_prof_<文件名>
+std::string getInstrumentedFilename(llvm::StringRef inputFullPath, llvm::StringRef outputFilename = "");
+
+// 插桩前端动作。继承 PluginASTAction，命令行工具和 clang 插件（见 InstrumentationPlugin.cpp）
+// 共用同一套改写流程，只有改写结果的去向不同
+class InstrumentationFrontendAction : public clang::PluginASTAction
 {
 public:
-    InstrumentationFrontendAction() = default;
+    // out/err 接收进度与错误信息；并行插桩时每个翻译单元各自缓冲，结束后按顺序输出
+    InstrumentationFrontendAction(const ProfilerConfig &config, const std::vector<std::string> &targetFuncs,
+                                  const std::string &outputFilename, llvm::raw_ostream &out = llvm::outs(),
+                                  llvm::raw_ostream &err = llvm::errs())
+        : config(config), targetFuncs(targetFuncs), outputFilename(outputFilename), out(out), err(err) {}
 
     std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(
         clang::CompilerInstance &CI, llvm::StringRef file) override;
@@ -52,8 +63,21 @@ public:
 
     void EndSourceFileAction() override;
 
+    // 命令行工具不经过插件参数解析
+    bool ParseArgs(const clang::CompilerInstance &CI, const std::vector<std::string> &args) override { return true; }
+
     const std::vector<std::string> &getIncludes() const { return includes; }
 
+protected:
+    // 处理改写后的主文件，默认写入 getInstrumentedFilename 给出的文件
+    virtual void emitInstrumentedSource(llvm::StringRef inputFile, llvm::StringRef code);
+
+    ProfilerConfig config;               // 运行时代码生成配置
+    std::vector<std::string> targetFuncs; // 目标函数，为空表示全部函数
+    std::string outputFilename;           // -o 指定的输出文件名
+    llvm::raw_ostream &out;
+    llvm::raw_ostream &err;
+
 private:
     clang::Rewriter rewriter;
     std::unique_ptr<IncludeTracker> includeTracker;
@@ -63,10 +87,22 @@ private:
 class InstrumentationFrontendActionFactory : public clang::tooling::FrontendActionFactory
 {
 public:
+    InstrumentationFrontendActionFactory(const ProfilerConfig &config, const std::vector<std::string> &targetFuncs,
+                                         const std::string &outputFilename, llvm::raw_ostream &out = llvm::outs(),
+                                         llvm::raw_ostream &err = llvm::errs())
+        : config(config), targetFuncs(targetFuncs), outputFilename(outputFilename), out(out), err(err) {}
+
     std::unique_ptr<clang::FrontendAction> create() override
     {
-        return std::make_unique<InstrumentationFrontendAction>();
+        return std::make_unique<InstrumentationFrontendAction>(config, targetFuncs, outputFilename, out, err);
     }
+
+private:
+    ProfilerConfig config;
+    std::vector<std::string> targetFuncs;
+    std::string outputFilename;
+    llvm::raw_ostream &out;
+    llvm::raw_ostream &err;
 };
 
 #endif //FRONTENDACTION_H
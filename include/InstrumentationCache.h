@@ -0,0 +1,37 @@
+#ifndef INSTRUMENTATION_CACHE_H
+#define INSTRUMENTATION_CACHE_H
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+
+// 一个翻译单元的缓存项
+struct CacheEntry
+{
+    std::string key;        // 为空表示预处理失败，不能缓存
+    std::string outputName; // 插桩结果的输出文件
+};
+
+// 插桩结果的磁盘缓存。缓存键由工具可执行文件、插桩选项、编译命令、主文件原文
+// 以及预处理后的完整词法单元序列计算得到，源文件或其包含的头文件变化时自动失效。
+// 各方法不修改对象状态，可在并行插桩的多个线程中同时使用
+class InstrumentationCache
+{
+public:
+    InstrumentationCache(std::string directory, const char *argv0);
+
+    // 只运行预处理器计算file的缓存项。命中时把缓存的结果复制到输出文件并返回true
+    bool lookup(const clang::tooling::CompilationDatabase &compilations, const std::string &file,
+                CacheEntry &entry, llvm::raw_ostream &out) const;
+
+    // 插桩完成后保存输出文件
+    void store(const CacheEntry &entry, llvm::raw_ostream &err) const;
+
+private:
+    std::string directory;
+    std::string toolIdentity; // 可执行文件路径、大小和修改时间，工具重新构建后缓存失效
+
+    std::string entryPath(const std::string &key) const;
+};
+
+#endif // INSTRUMENTATION_CACHE_H
@@ -2,6 +2,7 @@
 #define MEMORY_INSTRUMENTATION_H
 
 #include "../runtime/MemoryProfiler.h"
+#include "AffineAnalysis.h"
 #include "clang/AST/AST.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/RecursiveASTVisitor.h"
@@ -21,8 +22,10 @@ public:
 
     explicit MemoryInstrumentationVisitor(clang::Rewriter &R, clang::ASTContext &Context,
                                           std::vector<std::string> &includes,
-                                          const std::vector<std::string> targetFuncs)
-        : rewriter(R), ctx(Context), includes(includes), targetFunctions(), currentFunctionName("")
+                                          const std::vector<std::string> targetFuncs, const ProfilerConfig &config,
+                                          llvm::raw_ostream &log)
+        : rewriter(R), ctx(Context), includes(includes), config(config), log(log), targetFunctions(),
+          currentFunctionName("")
     {
         for (const auto &func : targetFuncs) {
             if (!func.empty()) {
@@ -57,6 +60,13 @@ public:
     // 遍历完成后恢复之前的函数上下文
     bool TraverseFunctionDecl(clang::FunctionDecl *FD);
 
+    // 遍历语句时维护语句上下文栈，进入语句时压栈、离开时出栈
+    bool dataTraverseStmtPre(clang::Stmt *S);
+    bool dataTraverseStmtPost(clang::Stmt *S);
+
+    // 语句内部的声明（如变量初始化表达式）压入声明边界
+    bool TraverseDecl(clang::Decl *D);
+
     // 访问返回语句，插入内存分析代码
     bool VisitReturnStmt(clang::ReturnStmt *RS);
 
@@ -72,6 +82,8 @@ private:
     clang::Rewriter &rewriter;
     clang::ASTContext &ctx;
     std::vector<std::string> &includes;
+    const ProfilerConfig config;                     // 运行时代码生成配置
+    llvm::raw_ostream &log;                          // 进度信息输出流，并行插桩时按翻译单元缓冲
     std::unordered_set<std::string> instrumentedVars;
     std::unordered_set<std::string> targetFunctions; // 目标函数集合
     std::string currentFunctionName;                 // 当前正在访问的函数名
@@ -80,6 +92,41 @@ private:
     std::unordered_map<std::string, std::unordered_set<std::string>>
         functionInitializedVars; // Track initialized variables per function
 
+    // 语句上下文：由父节点的上下文递推得到，访问点只需查看栈顶即可确定插入位置，
+    // 不必沿父节点链反复向上查找
+    struct StmtContext
+    {
+        const clang::Stmt *stmt = nullptr;             // 为空表示声明边界
+        const clang::Stmt *containingStmt = nullptr;   // 所在的完整语句（复合语句或控制流语句的直接子语句）
+        bool inCondition = false;                      // 是否在控制流语句的条件/初始化部分
+        const clang::Stmt *conditionAnchor = nullptr;  // 条件部分中的访问记录插入到该控制流语句之前
+        const clang::Stmt *outermostControl = nullptr; // 到最近的复合语句为止最外层的控制流语句
+        bool hasCompound = false;                      // 自身或祖先中是否有复合语句
+    };
+    std::vector<StmtContext> contextStack;
+
+    // 循环级分析：变量在某个循环中的访问单独建一份分析结果 __<var>_loop<id>_prof
+    struct LoopSite
+    {
+        const clang::Stmt *loop = nullptr; // for、while 或 do 循环
+        unsigned id = 0;                   // 翻译单元内的循环编号
+        unsigned line = 0;                 // 循环起始行号
+    };
+    std::unordered_map<std::string, std::vector<LoopSite>> loopSites; // 当前函数中各变量被直接访问的循环
+    unsigned loopSiteCount = 0;
+
+    // 遍历函数之前收集每个变量的各次引用所在的最内层循环
+    void collectLoopSites(clang::FunctionDecl *FD);
+
+    // 访问所属循环的分析结果名（不含前后缀）；不在循环中或循环的分析结果未建立时为变量名本身
+    std::string getSiteVar(const std::string &VarName, const clang::Stmt *Loop) const;
+
+    // 表达式所在的最内层循环，表达式正在被访问时位于栈顶
+    const clang::Stmt *getEnclosingLoop(const clang::Stmt *S) const;
+
+    // 表达式的祖先语句，由内向外到最内层循环的父语句为止，声明边界为空指针
+    std::vector<const clang::Stmt *> getLoopAncestors(const clang::Stmt *S) const;
+
     // 获取表达式的源代码
     std::string getSourceText(const clang::Stmt *stmt) const;
 
@@ -110,23 +157,49 @@ private:
     // 访问数组下标表达式，记录数组访问
     bool handleArraySubscriptExpr(const clang::ArraySubscriptExpr *ASE) const;
 
-    // 访问一元运算符，处理指针解引用
-    bool handleUnaryOperator(const clang::UnaryOperator *UO) const;
+    // 在仿射访问所在循环之前插入摘要记录，成功时不再需要逐次记录
+    bool insertAffineSummary(const clang::ArraySubscriptExpr *ASE, const AffineAccess &Access,
+                             const std::string &VarName) const;
+
+    // 生成一次访问的记录调用，分维统计时多维数组访问另附各维下标
+    std::string generateRecordCall(const clang::Expr *E, const std::string &VarName,
+                                   const std::string &AccessExpr) const;
+
+    // 生成多维数组访问的 __mem_index 调用，维数为1或超过 MEM_MAX_DIMS 时为空
+    std::string generateIndexCall(const std::string &VarName, const std::vector<std::string> &Indices) const;
 
-    // 检查表达式是否在控制流语句的条件/初始化部分（通用解决方案）
-    bool isInControlFlowCondition(const clang::Expr *E) const;
+    // 访问的读写类别：MEM_LOAD、MEM_STORE 或 MEM_UPDATE
+    std::string getAccessKind(const clang::Expr *E) const;
 
-    // 检查表达式是否在指定的AST子树中
-    bool isExpressionInSubtree(const clang::Expr *expr, const clang::Stmt *subtreeRoot) const;
+    // 访问一元运算符，处理指针解引用
+    bool handleUnaryOperator(const clang::UnaryOperator *UO) const;
 
-    // 找到合适的插入位置（控制流语句之前的位置）
-    clang::SourceLocation findAppropriateInsertLocation(const clang::Expr *E) const;
+    // 查找表达式的语句上下文，表达式正在被访问时位于栈顶
+    const StmtContext *findContext(const clang::Stmt *S) const;
 
     unsigned getIndentation(clang::SourceLocation Loc) const;
 
     std::string getLine(clang::SourceLocation Loc) const;
 
     std::string generateAnalysisCode(const std::string &functionName);
+
+    // 生成变量分析结果的声明与初始化代码，Dims 为变量作为数组使用时的维数；
+    // Site 非空时生成变量在该循环中的分析结果
+    std::string generateInitCode(const std::string &VarName, const std::string &FuncName, const std::string &AddrExpr,
+                                 unsigned Dims, const std::string &Indent, const LoopSite *Site = nullptr) const;
+
+    // 为变量被访问的每个循环生成分析结果，并登记到函数的分析结果中
+    std::string generateLoopInitCode(const std::string &VarName, const std::string &FuncName,
+                                     const std::string &AddrExpr, unsigned Dims, const std::string &Indent);
+
+    // 记录函数使用的分析结果指针
+    std::string getProfileRef(const std::string &VarName) const;
+
+    // 线程归约模式下，在函数定义之前声明各变量共享的归约结果
+    void insertSharedProfiles(const clang::FunctionDecl *FD);
+
+    // 共享归约结果的变量名
+    static std::string getSharedProfileName(const std::string &functionName, const std::string &varName);
 };
 
 // AST消费者类，用于处理整个翻译单元
@@ -136,11 +209,14 @@ private:
     const std::vector<std::string> targetFunctions;
     clang::Rewriter &rewriter;
     std::vector<std::string> &includes;
+    const ProfilerConfig config;
+    llvm::raw_ostream &log;
 
 public:
     explicit MemoryInstrumentationConsumer(clang::Rewriter &R, std::vector<std::string> &includes,
-                                           const std::vector<std::string> &targetFuncs)
-        : targetFunctions(targetFuncs), rewriter(R), includes(includes)
+                                           const std::vector<std::string> &targetFuncs, const ProfilerConfig &config,
+                                           llvm::raw_ostream &log)
+        : targetFunctions(targetFuncs), rewriter(R), includes(includes), config(config), log(log)
     {
     }
 
@@ -0,0 +1,17 @@
+#ifndef PARALLEL_INSTRUMENTATION_H
+#define PARALLEL_INSTRUMENTATION_H
+
+#include "InstrumentationCache.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include <string>
+#include <vector>
+
+// 用jobs个线程并行插桩多个翻译单元。每个翻译单元使用独立的ClangTool、前端动作和
+// 文件系统视图，进度与诊断信息分别缓冲，全部完成后按输入顺序输出。
+// cache非空时先查找缓存，命中的翻译单元不再运行前端。
+// 返回值与ClangTool::run一致：0 成功，1 出错，2 有文件被跳过
+int runParallelInstrumentation(const clang::tooling::CompilationDatabase &compilations,
+                               const std::vector<std::string> &files, unsigned jobs,
+                               const InstrumentationCache *cache = nullptr);
+
+#endif // PARALLEL_INSTRUMENTATION_H
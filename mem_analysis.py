@@ -1,14 +1,79 @@
 #!/usr/bin/env python3
 import sys
 import re
+import argparse
+import binascii
+import json
+import struct
 from collections import defaultdict
 import csv
-from typing import Dict, List, NamedTuple, Set
+from typing import Dict, List, NamedTuple, Optional, Set, Tuple
+
+# 二进制记录格式（与运行时 __mem_dump 一致，小端序）：
+#   u32 magic, u16 version, u16 thread_id, u16 var_name_len, u16 func_name_len,
+#   u16 pattern_count, u16 sample_burst, u32 sample_period, u32 type_size,
+#   u64 base_addr, u64 end_addr, u64 total_accesses, var_name, func_name,
+#   pattern_count * {i64 step, u64 count, u64 error}, u16 nested_count,
+#   nested_count * {i64 step, u64 length, i64 jump, u64 count}, u16 heat_bins,
+#   [u64 heat_base, u64 bucket_bytes, heat_bins * u64 count]（heat_bins 为 0 时省略）,
+#   u16 phase_count, u16 phase_top,
+#   phase_count * {u64 start, u64 accesses, u64 analyzed, u64 low, u64 high, phase_top * {i64 step, u64 count}},
+#   u64 cycles, u64 loads, u64 stores, u16 kind_top, 2 * kind_top * {i64 step, u64 count}（先读后写）,
+#   u16 run_bins, [i64 run_step, u64 runs, u64 run_total, u64 run_max, run_bins * u64 count]（run_bins 为 0 时省略）,
+#   u16 dims, [u16 dim_top, u64 dim_accesses, dims * {u64 moves, dim_top * {i64 step, u64 count}}]（dims 为 0 时省略）,
+#   u32 loop_line, u32 share_line,
+#   [u64 shared_read, u64 shared_write, u64 false_sharing, u16 false_count, false_count * i64 offset]（share_line 为 0 时省略）,
+#   u16 reuse_bins, [u32 line_size, reuse_bins * u64 count]（最后一格为首次访问，reuse_bins 为 0 时省略）
+# 版本 1 的步长为无符号绝对值，且没有嵌套模式部分；版本 2 没有热度直方图部分；版本 3 没有阶段部分；
+# 版本 4 没有周期数；版本 5 没有读写部分；版本 6 没有连续段部分；版本 7 没有分维部分；版本 8 没有循环行号；
+# 版本 9 没有线程间共享部分；版本 10 没有重用距离部分
+PROFILE_MAGIC = b'MPRF'
+PROFILE_VERSIONS = (1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11)
+PROFILE_HEADER = struct.Struct('<4sHHHHHHIIQQQ')
+PROFILE_PATTERN_V1 = struct.Struct('<QQQ')
+PROFILE_PATTERN = struct.Struct('<qQQ')
+PROFILE_NESTED_COUNT = struct.Struct('<H')
+PROFILE_NESTED = struct.Struct('<qQqQ')
+PROFILE_HEAT_COUNT = struct.Struct('<H')
+PROFILE_HEAT = struct.Struct('<QQ')
+PROFILE_HEAT_BIN = struct.Struct('<Q')
+PROFILE_PHASE_COUNT = struct.Struct('<HH')
+PROFILE_PHASE = struct.Struct('<QQQQQ')
+PROFILE_PHASE_STEP = struct.Struct('<qQ')
+PROFILE_CYCLES = struct.Struct('<Q')
+PROFILE_KIND_COUNT = struct.Struct('<QQH')
+PROFILE_KIND_STEP = struct.Struct('<qQ')
+PROFILE_RUN_COUNT = struct.Struct('<H')
+PROFILE_RUN = struct.Struct('<qQQQ')
+PROFILE_RUN_BIN = struct.Struct('<Q')
+PROFILE_DIM_COUNT = struct.Struct('<H')
+PROFILE_DIM = struct.Struct('<HQ')
+PROFILE_DIM_MOVES = struct.Struct('<Q')
+PROFILE_DIM_STEP = struct.Struct('<qQ')
+PROFILE_LOOP = struct.Struct('<I')
+PROFILE_SHARE_LINE = struct.Struct('<I')
+PROFILE_SHARE = struct.Struct('<QQQH')
+PROFILE_SHARE_OFFSET = struct.Struct('<q')
+PROFILE_REUSE_COUNT = struct.Struct('<H')
+PROFILE_REUSE_LINE = struct.Struct('<I')
+PROFILE_REUSE_BIN = struct.Struct('<Q')
+
+# MT-3000 每个 DSP 核的 AM 片上存储为 768KB，DMA 传输方案默认按此容量划分缓冲区
+DEFAULT_SPM_SIZE = 768 * 1024
+# 步长不超过该值时，连续传输整段数据比逐元素跨步传输更划算
+DENSE_STRIDE_LIMIT = 4
+# 文本报告不含元素大小，按最大的常见标量类型估计，保证分块不超出片上容量
+ASSUMED_ELEM_SIZE = 8
+# 热区为覆盖该比例访问的最短连续地址范围（与运行时 MEM_HEAT_HOT 一致）
+HOT_SHARE = 0.9
+# 变化最频繁的维至少比最后一维多变化这么多倍时提示交换循环（与运行时一致）
+INTERCHANGE_RATIO = 8
 
 class Pattern:
-    def __init__(self, step: int, percentage: float):
+    def __init__(self, step: int, percentage: float, error: float = 0.0):
         self.step = step
         self.percentage = percentage
+        self.error = error
         
     @property
     def access_count(self) -> float:
@@ -22,6 +87,24 @@ class Pattern:
     def access_count(self, value: float):
         self._access_count = value
 
+class NestedPattern:
+    """连续 length 次步长为 step 的访问之后跳转 jump 个元素"""
+    def __init__(self, step: int, length: int, jump: int, percentage: float):
+        self.step = step
+        self.length = length
+        self.jump = jump
+        self.percentage = percentage
+        self.access_count = 0.0
+
+class Phase:
+    """从第 start 次访问开始、共 accesses 次访问的阶段，steps 为 (步长, 百分比) 列表"""
+    def __init__(self, start: int, accesses: int, steps: List[Tuple[int, float]], span: int, irregular: bool):
+        self.start = start
+        self.accesses = accesses
+        self.steps = steps
+        self.span = span
+        self.irregular = irregular
+
 class MemoryAccess:
     def __init__(self, thread_id: int, var_name: str, func_name: str, elements: int, accesses: int):
         self.thread_id = thread_id
@@ -30,17 +113,217 @@ class MemoryAccess:
         self.elements = elements
         self.accesses = accesses
         self.patterns: List[Pattern] = []
+        self.nested: List[NestedPattern] = []
+        self.exact = False  # 来自二进制记录时模式计数为精确值
+        self.type_size = 0  # 元素大小，文本报告中没有该信息
+        self.heat: Dict[int, float] = {}  # 热度直方图：桶起始地址 -> 访问次数
+        self.heat_width = 0  # 桶宽（字节），0 表示没有热度直方图
+        self.phases: List[Phase] = []  # 按时间顺序的访问阶段
+        self.cycles = 0  # 所在函数的周期数，0 表示未计时
+        self.loads: Optional[int] = None  # 读次数，None 表示没有区分读写
+        self.stores: Optional[int] = None  # 写次数
+        self.load_steps: List[Tuple[int, float]] = []  # 读的 (步长, 百分比)
+        self.store_steps: List[Tuple[int, float]] = []  # 写的 (步长, 百分比)
+        self.run_step: Optional[int] = None  # 统计连续段的步长，None 表示没有连续段直方图
+        self.runs = 0  # 连续段数
+        self.run_total = 0.0  # 各段元素数之和
+        self.run_max = 0  # 最长一段的元素数
+        self.run_hist: Dict[int, float] = {}  # 分桶下界（元素数，2 的幂）-> 段数
+        self.dim_accesses = 0.0  # 记录了各维下标的访问次数，0 表示没有分维统计
+        self.dim_moves: List[float] = []  # 由外向内各维下标发生变化的次数
+        self.dim_steps: List[Dict[int, float]] = []  # 各维下标的变化 -> 次数
+        self.loop_line = 0  # 所在循环的起始行号，0 表示整个函数或函数中循环以外的访问
+        self.share_line = 0  # 比较线程间共享的行大小（字节），0 表示没有共享统计
+        self.shared_read = 0  # 多个线程读同一字节的行数（按采样率还原）
+        self.shared_write = 0  # 一个线程写、其他线程也访问同一字节的行数
+        self.false_sharing = 0  # 一个线程写、其他线程访问同一行中其他字节的行数
+        self.false_offsets: List[int] = []  # 部分伪共享行相对变量起始地址的偏移
+        self.reuse_hist: Dict[int, float] = {}  # 重用距离分桶上界（字节，不含）-> 访问次数
+        self.reuse_cold = 0.0  # 首次访问缓存行的次数
     
     def calculate_pattern_access_counts(self):
         """Calculate actual access counts for each pattern based on percentage"""
+        if self.exact:
+            return
         for pattern in self.patterns:
             pattern.access_count = self.accesses * (pattern.percentage / 100.0)
+        for nested in self.nested:
+            nested.access_count = self.accesses * (nested.percentage / 100.0)
+
+def decode_profile_record(data: bytes, offset: int = 0) -> Tuple[MemoryAccess, int]:
+    """解码一条二进制记录，返回记录和下一条记录的偏移"""
+    (magic, version, thread_id, name_len, func_len, pattern_count, sample_burst,
+     sample_period, type_size, base_addr, end_addr, total) = PROFILE_HEADER.unpack_from(data, offset)
+    if magic != PROFILE_MAGIC:
+        raise ValueError(f"偏移 {offset} 处不是有效的访存记录")
+    if version not in PROFILE_VERSIONS:
+        raise ValueError(f"不支持的记录版本 {version}")
+    offset += PROFILE_HEADER.size
+    var_name = data[offset:offset + name_len].decode('ascii', 'replace')
+    offset += name_len
+    func_name = data[offset:offset + func_len].decode('ascii', 'replace')
+    offset += func_len
+
+    access = MemoryAccess(thread_id, var_name, func_name, end_addr - base_addr + type_size, total)
+    access.exact = True
+    access.type_size = type_size
+    pattern_format = PROFILE_PATTERN if version >= 2 else PROFILE_PATTERN_V1
+    for _ in range(pattern_count):
+        step, count, error = pattern_format.unpack_from(data, offset)
+        offset += pattern_format.size
+        pattern = Pattern(step, count * 100.0 / total if total else 0.0,
+                          error * 100.0 / total if total else 0.0)
+        pattern.access_count = count
+        access.patterns.append(pattern)
+    access.patterns.sort(key=lambda x: x.access_count, reverse=True)
+
+    if version >= 2:
+        nested_count, = PROFILE_NESTED_COUNT.unpack_from(data, offset)
+        offset += PROFILE_NESTED_COUNT.size
+        for _ in range(nested_count):
+            step, length, jump, count = PROFILE_NESTED.unpack_from(data, offset)
+            offset += PROFILE_NESTED.size
+            # 每次出现覆盖 length 次内层访问和一次跳转
+            covered = count * (length + 1)
+            nested = NestedPattern(step, length, jump, covered * 100.0 / total if total else 0.0)
+            nested.access_count = covered
+            access.nested.append(nested)
+        access.nested.sort(key=lambda x: x.access_count, reverse=True)
+
+    if version >= 3:
+        heat_bins, = PROFILE_HEAT_COUNT.unpack_from(data, offset)
+        offset += PROFILE_HEAT_COUNT.size
+        if heat_bins:
+            heat_base, access.heat_width = PROFILE_HEAT.unpack_from(data, offset)
+            offset += PROFILE_HEAT.size
+            for i in range(heat_bins):
+                count, = PROFILE_HEAT_BIN.unpack_from(data, offset)
+                offset += PROFILE_HEAT_BIN.size
+                if count:
+                    access.heat[heat_base + i * access.heat_width] = count
+
+    if version >= 4:
+        phase_count, phase_top = PROFILE_PHASE_COUNT.unpack_from(data, offset)
+        offset += PROFILE_PHASE_COUNT.size
+        for _ in range(phase_count):
+            start, length, analyzed, low, high = PROFILE_PHASE.unpack_from(data, offset)
+            offset += PROFILE_PHASE.size
+            steps = []
+            for _ in range(phase_top):
+                step, count = PROFILE_PHASE_STEP.unpack_from(data, offset)
+                offset += PROFILE_PHASE_STEP.size
+                if count and analyzed:
+                    steps.append((step, count * 100.0 / analyzed))
+            irregular = not steps or steps[0][1] < 50.0
+            access.phases.append(Phase(start, length, steps, high - low + type_size, irregular))
+
+    if version >= 5:
+        access.cycles, = PROFILE_CYCLES.unpack_from(data, offset)
+        offset += PROFILE_CYCLES.size
+
+    if version >= 6:
+        loads, stores, kind_top = PROFILE_KIND_COUNT.unpack_from(data, offset)
+        offset += PROFILE_KIND_COUNT.size
+        for steps, total in ((access.load_steps, loads), (access.store_steps, stores)):
+            for _ in range(kind_top):
+                step, count = PROFILE_KIND_STEP.unpack_from(data, offset)
+                offset += PROFILE_KIND_STEP.size
+                if count:
+                    steps.append((step, count * 100.0 / total))
+        if kind_top:
+            access.loads, access.stores = loads, stores
+
+    if version >= 7:
+        run_bins, = PROFILE_RUN_COUNT.unpack_from(data, offset)
+        offset += PROFILE_RUN_COUNT.size
+        if run_bins:
+            access.run_step, access.runs, access.run_total, access.run_max = PROFILE_RUN.unpack_from(data, offset)
+            offset += PROFILE_RUN.size
+            for i in range(run_bins):
+                count, = PROFILE_RUN_BIN.unpack_from(data, offset)
+                offset += PROFILE_RUN_BIN.size
+                if count:
+                    access.run_hist[1 << i] = count
+
+    if version >= 8:
+        dims, = PROFILE_DIM_COUNT.unpack_from(data, offset)
+        offset += PROFILE_DIM_COUNT.size
+        if dims:
+            dim_top, access.dim_accesses = PROFILE_DIM.unpack_from(data, offset)
+            offset += PROFILE_DIM.size
+            for _ in range(dims):
+                moves, = PROFILE_DIM_MOVES.unpack_from(data, offset)
+                offset += PROFILE_DIM_MOVES.size
+                steps = {}
+                for _ in range(dim_top):
+                    step, count = PROFILE_DIM_STEP.unpack_from(data, offset)
+                    offset += PROFILE_DIM_STEP.size
+                    if count:
+                        steps[step] = count
+                access.dim_moves.append(moves)
+                access.dim_steps.append(steps)
+
+    if version >= 9:
+        access.loop_line, = PROFILE_LOOP.unpack_from(data, offset)
+        offset += PROFILE_LOOP.size
+
+    if version >= 10:
+        access.share_line, = PROFILE_SHARE_LINE.unpack_from(data, offset)
+        offset += PROFILE_SHARE_LINE.size
+        if access.share_line:
+            access.shared_read, access.shared_write, access.false_sharing, count = \
+                PROFILE_SHARE.unpack_from(data, offset)
+            offset += PROFILE_SHARE.size
+            for _ in range(count):
+                line_offset, = PROFILE_SHARE_OFFSET.unpack_from(data, offset)
+                offset += PROFILE_SHARE_OFFSET.size
+                access.false_offsets.append(line_offset)
+
+    if version >= 11:
+        reuse_bins, = PROFILE_REUSE_COUNT.unpack_from(data, offset)
+        offset += PROFILE_REUSE_COUNT.size
+        if reuse_bins:
+            line_size, = PROFILE_REUSE_LINE.unpack_from(data, offset)
+            offset += PROFILE_REUSE_LINE.size
+            for i in range(reuse_bins):
+                count, = PROFILE_REUSE_BIN.unpack_from(data, offset)
+                offset += PROFILE_REUSE_BIN.size
+                if i == reuse_bins - 1:
+                    access.reuse_cold = count
+                elif count:
+                    access.reuse_hist[line_size << i] = count
+    return access, offset
+
+def parse_binary_profiles(data: bytes) -> List[MemoryAccess]:
+    """解码主机端 MEM_DUMP_FILE 写出的连续二进制记录"""
+    accesses = []
+    offset = 0
+    while offset < len(data):
+        access, offset = decode_profile_record(data, offset)
+        if access.accesses > 0:
+            accesses.append(access)
+    return accesses
 
 def parse_memory_analysis(filepath: str) -> List[MemoryAccess]:
     accesses = []
     
-    header_pattern = r'\[Memory Analysis\] thread (\d+): (\w+) in (\w+): elements=(\d+), accesses=(\d+)'
-    pattern_line = r'Pattern \d+: step=(\d+) \(([\d.]+)%\)'
+    with open(filepath, 'rb') as f:
+        if f.read(len(PROFILE_MAGIC)) == PROFILE_MAGIC:
+            f.seek(0)
+            return parse_binary_profiles(f.read())
+    
+    header_pattern = (r'\[Memory Analysis\] thread (\d+): (\w+) in (\w+)(?:, loop at line (\d+))?: '
+                      r'elements=(\d+), accesses=(\d+)')
+    pattern_line = r'Pattern \d+: step=(-?\d+) \(([\d.]+)%\)'
+    nested_line = r'Nested \d+: (\d+) x step=(-?\d+), then step=(-?\d+) \(([\d.]+)%\)'
+    phase_line = r'Phase \d+: accesses (\d+)-(\d+),( irregular,)?((?: step=-?\d+ \([\d.]+%\),)*) span=(\d+)B'
+    kind_line = r'(Loads|Stores): (\d+)((?:, step=-?\d+ \([\d.]+%\))*)'
+    run_line = r'Runs of step=(-?\d+): (\d+) runs, mean=([\d.]+), max=(\d+), lengths:(.*)'
+    dim_line = r'Dimension (\d+): (?:step=(-?\d+), changes in ([\d.]+)% of accesses|unchanged)'
+    share_line = r'Sharing \((\d+)B lines\): read=(\d+), write=(\d+), false=(\d+)(?:, false at((?: [+-]\d+B)*))?'
+    reuse_line = r'Reuse distance:((?: <\d+B=[\d.]+%)*) cold=([\d.]+)%'
+    heat_line = r'Heat map \((\d+)B buckets from 0x([0-9a-f]+)\):([\d. ]+)'
+    record_line = r'\[Memory Profile\] ([0-9a-f]+)'
     
     current_access = None
     
@@ -63,12 +346,18 @@ def parse_memory_analysis(filepath: str) -> List[MemoryAccess]:
                         try:
                             line = accumulated_line.decode('ascii')
                             
+                            record_match = re.search(record_line, line)
                             header_match = re.search(header_pattern, line)
-                            if header_match:
+                            if record_match:
+                                record, _ = decode_profile_record(binascii.unhexlify(record_match.group(1)))
+                                if record.accesses > 0:
+                                    accesses.append(record)
+                            elif header_match:
                                 if current_access and current_access.accesses > 0:
                                     accesses.append(current_access)
                                 
-                                thread_id, var_name, func_name, elements, accesses_count = header_match.groups()
+                                thread_id, var_name, func_name, loop_line, elements, accesses_count = \
+                                    header_match.groups()
                                 current_access = MemoryAccess(
                                     thread_id=int(thread_id),
                                     var_name=var_name,
@@ -76,14 +365,81 @@ def parse_memory_analysis(filepath: str) -> List[MemoryAccess]:
                                     elements=int(elements),
                                     accesses=int(accesses_count)
                                 )
+                                current_access.loop_line = int(loop_line or 0)
+                                cycles_match = re.search(r'cycles=(\d+)', line)
+                                if cycles_match:
+                                    current_access.cycles = int(cycles_match.group(1))
                             else:
                                 pattern_match = re.search(pattern_line, line)
+                                nested_match = re.search(nested_line, line)
+                                heat_match = re.search(heat_line, line)
+                                phase_match = re.search(phase_line, line)
+                                kind_match = re.search(kind_line, line)
+                                run_match = re.search(run_line, line)
+                                dim_match = re.search(dim_line, line)
+                                share_match = re.search(share_line, line)
+                                reuse_match = re.search(reuse_line, line)
                                 if pattern_match and current_access:
                                     step, percentage = pattern_match.groups()
                                     current_access.patterns.append(Pattern(
                                         step=int(step),
                                         percentage=float(percentage)
                                     ))
+                                elif nested_match and current_access:
+                                    length, step, jump, percentage = nested_match.groups()
+                                    current_access.nested.append(NestedPattern(
+                                        int(step), int(length), int(jump), float(percentage)))
+                                elif phase_match and current_access:
+                                    start, end, irregular, steps, span = phase_match.groups()
+                                    steps = [(int(step), float(share)) for step, share in
+                                             re.findall(r'step=(-?\d+) \(([\d.]+)%\)', steps)]
+                                    current_access.phases.append(Phase(
+                                        int(start), int(end) - int(start), steps, int(span), bool(irregular)))
+                                elif run_match and current_access:
+                                    step, runs, mean, longest, bins = run_match.groups()
+                                    current_access.run_step = int(step)
+                                    current_access.runs = int(runs)
+                                    current_access.run_total = float(mean) * int(runs)
+                                    current_access.run_max = int(longest)
+                                    for low, share in re.findall(r'(\d+)(?:-\d+|\+)?=([\d.]+)%', bins):
+                                        current_access.run_hist[int(low)] = int(runs) * float(share) / 100.0
+                                elif dim_match and current_access:
+                                    # 文本报告只有每维最频繁的变化，次数按占比估计
+                                    _, step, share = dim_match.groups()
+                                    moves = current_access.accesses * float(share or 0) / 100.0
+                                    current_access.dim_accesses = current_access.accesses
+                                    current_access.dim_moves.append(moves)
+                                    current_access.dim_steps.append({int(step): moves} if step else {})
+                                elif share_match and current_access:
+                                    line_bytes, read, write, false, offsets = share_match.groups()
+                                    current_access.share_line = int(line_bytes)
+                                    current_access.shared_read = int(read)
+                                    current_access.shared_write = int(write)
+                                    current_access.false_sharing = int(false)
+                                    current_access.false_offsets = [int(x) for x in
+                                                                    re.findall(r'([+-]\d+)B', offsets or '')]
+                                elif reuse_match and current_access:
+                                    # 文本报告只有占比，次数按总访问次数估计
+                                    bins, cold = reuse_match.groups()
+                                    for bound, share in re.findall(r'<(\d+)B=([\d.]+)%', bins):
+                                        current_access.reuse_hist[int(bound)] = \
+                                            current_access.accesses * float(share) / 100.0
+                                    current_access.reuse_cold = current_access.accesses * float(cold) / 100.0
+                                elif kind_match and current_access:
+                                    kind, count, steps = kind_match.groups()
+                                    steps = [(int(step), float(share)) for step, share in
+                                             re.findall(r'step=(-?\d+) \(([\d.]+)%\)', steps)]
+                                    if kind == 'Loads':
+                                        current_access.loads, current_access.load_steps = int(count), steps
+                                    else:
+                                        current_access.stores, current_access.store_steps = int(count), steps
+                                elif heat_match and current_access:
+                                    width, base, shares = heat_match.groups()
+                                    current_access.heat_width = int(width)
+                                    for i, share in enumerate(shares.split()):
+                                        if float(share) > 0:
+                                            current_access.heat[int(base, 16) + i * int(width)] = \
+                                                current_access.accesses * float(share) / 100.0
                         except Exception as e:
                             print(f"警告：处理行时出错 {e}, 跳过此行")
                         
@@ -97,23 +453,23 @@ def parse_memory_analysis(filepath: str) -> List[MemoryAccess]:
     return accesses
 
 def merge_memory_analysis(accesses: List[MemoryAccess]) -> List[MemoryAccess]:
-    # 按线程号、变量名和函数名分组
+    # 按线程号、变量名、函数名和所在循环分组
     groups = defaultdict(list)
     for access in accesses:
         # 确保只处理访问次数大于0的记录
         if access.accesses > 0:
-            key = (access.thread_id, access.var_name, access.func_name)
+            key = (access.thread_id, access.var_name, access.func_name, access.loop_line)
             groups[key].append(access)
     
     merged_results = []
     
-    # 按变量名和函数名的组合进行合并
+    # 按变量名、函数名和所在循环的组合进行合并
     thread_var_func_groups = defaultdict(list)
-    for (thread_id, var_name, func_name), group in groups.items():
-        key = (var_name, func_name)
+    for (thread_id, var_name, func_name, loop_line), group in groups.items():
+        key = (var_name, func_name, loop_line)
         thread_var_func_groups[key].extend(group)
     
-    for (var_name, func_name), group in thread_var_func_groups.items():
+    for (var_name, func_name, loop_line), group in thread_var_func_groups.items():
         # 取最大元素大小
         max_elements = max(access.elements for access in group)
         
@@ -129,21 +485,174 @@ def merge_memory_analysis(accesses: List[MemoryAccess]) -> List[MemoryAccess]:
             for pattern in access.patterns:
                 step_access_counts[pattern.step] += pattern.access_count
         
+        # 二进制记录的误差上界随计数一起累加
+        step_errors = defaultdict(float)
+        for access in group:
+            for pattern in access.patterns:
+                step_errors[pattern.step] += pattern.error * access.accesses / 100.0
+        
+        # 嵌套模式按（内层步长、长度、跳转）合并
+        nested_access_counts = defaultdict(float)
+        for access in group:
+            for nested in access.nested:
+                nested_access_counts[(nested.step, nested.length, nested.jump)] += nested.access_count
+        
         # 创建合并后的访问记录
         merged_access = MemoryAccess(0, var_name, func_name, max_elements, total_accesses)
+        merged_access.loop_line = loop_line
+        merged_access.exact = all(access.exact for access in group)
+        merged_access.type_size = max(access.type_size for access in group)
         
-        # 计算新的访问模式百分比，并且只保留大于等于5%的模式
+        # 计算新的访问模式百分比；文本输入只有被四舍五入过的前几个模式，只保留大于等于5%的模式
+        min_percentage = 0.0 if merged_access.exact else 5.0
         for step, access_count in step_access_counts.items():
             percentage = (access_count / total_accesses) * 100
-            if percentage >= 5.0:  # 只保留百分比大于等于5%的模式
-                merged_access.patterns.append(Pattern(step, percentage))
+            if percentage >= min_percentage:
+                pattern = Pattern(step, percentage, step_errors[step] * 100 / total_accesses)
+                pattern.access_count = access_count
+                merged_access.patterns.append(pattern)
         
         # 按百分比降序排序模式
         merged_access.patterns.sort(key=lambda x: x.percentage, reverse=True)
+        
+        for (step, length, jump), access_count in nested_access_counts.items():
+            percentage = (access_count / total_accesses) * 100
+            if percentage >= min_percentage:
+                nested = NestedPattern(step, length, jump, percentage)
+                nested.access_count = access_count
+                merged_access.nested.append(nested)
+        merged_access.nested.sort(key=lambda x: x.percentage, reverse=True)
+        
+        # 桶宽都是 2 的幂且起始地址按桶宽对齐，较窄的桶整体落入最宽桶宽下的一个桶
+        merged_access.heat_width = max(access.heat_width for access in group)
+        for access in group:
+            for start, count in access.heat.items():
+                bucket = start - start % merged_access.heat_width
+                merged_access.heat[bucket] = merged_access.heat.get(bucket, 0) + count
+        
+        # 阶段是各线程自己的时间线，取第一条带阶段的记录
+        merged_access.phases = next((access.phases for access in group if access.phases), [])
+        
+        # 同一线程的多条记录周期数相加；各线程并行执行，取最慢的线程
+        thread_cycles = defaultdict(int)
+        for access in group:
+            thread_cycles[access.thread_id] += access.cycles
+        merged_access.cycles = max(thread_cycles.values())
+        
+        # 连续段直方图：跟踪的步长相同的记录相加，取覆盖元素最多的步长
+        runs = defaultdict(list)
+        for access in group:
+            if access.run_step is not None:
+                runs[access.run_step].append(access)
+        if runs:
+            step, parts = max(runs.items(), key=lambda item: sum(access.run_total for access in item[1]))
+            merged_access.run_step = step
+            merged_access.runs = sum(access.runs for access in parts)
+            merged_access.run_total = sum(access.run_total for access in parts)
+            merged_access.run_max = max(access.run_max for access in parts)
+            for access in parts:
+                for low, count in access.run_hist.items():
+                    merged_access.run_hist[low] = merged_access.run_hist.get(low, 0) + count
+        
+        # 各维下标的变化次数相加
+        for access in group:
+            merged_access.dim_accesses += access.dim_accesses
+            for d, (moves, steps) in enumerate(zip(access.dim_moves, access.dim_steps)):
+                if d == len(merged_access.dim_moves):
+                    merged_access.dim_moves.append(0.0)
+                    merged_access.dim_steps.append({})
+                merged_access.dim_moves[d] += moves
+                for step, count in steps.items():
+                    merged_access.dim_steps[d][step] = merged_access.dim_steps[d].get(step, 0) + count
+        
+        # 多次调用的合并报告比较的是同一批行，各类行数取最大值，伪共享行的偏移取并集
+        shares = [access for access in group if access.share_line]
+        if shares:
+            merged_access.share_line = max(access.share_line for access in shares)
+            merged_access.shared_read = max(access.shared_read for access in shares)
+            merged_access.shared_write = max(access.shared_write for access in shares)
+            merged_access.false_sharing = max(access.false_sharing for access in shares)
+            merged_access.false_offsets = sorted({line_offset for access in shares
+                                                  for line_offset in access.false_offsets})
+        
+        # 重用距离直方图按分桶相加
+        for access in group:
+            merged_access.reuse_cold += access.reuse_cold
+            for bound, count in access.reuse_hist.items():
+                merged_access.reuse_hist[bound] = merged_access.reuse_hist.get(bound, 0) + count
+        
+        # 读写次数相加，步长按次数加权合并
+        kinds = [access for access in group if access.loads is not None]
+        if kinds:
+            merged_access.loads = sum(access.loads for access in kinds)
+            merged_access.stores = sum(access.stores for access in kinds)
+            merged_access.load_steps = merge_kind_steps([(access.loads, access.load_steps) for access in kinds])
+            merged_access.store_steps = merge_kind_steps([(access.stores, access.store_steps) for access in kinds])
         merged_results.append(merged_access)
     
+    # 区分循环时同一函数的结果按访问次数从多到少排列，函数之间保持出现顺序
+    if any(access.loop_line for access in merged_results):
+        order = {}
+        for access in merged_results:
+            order.setdefault(access.func_name, len(order))
+        merged_results.sort(key=lambda access: (order[access.func_name], -access.accesses))
+    
     return merged_results
 
+def merge_kind_steps(parts: List[Tuple[int, List[Tuple[int, float]]]]) -> List[Tuple[int, float]]:
+    """合并各记录中读或写的 (步长, 百分比) 列表，parts 为 (次数, 步长列表)"""
+    total = sum(count for count, _ in parts)
+    counts = defaultdict(float)
+    for count, steps in parts:
+        for step, share in steps:
+            counts[step] += count * share / 100.0
+    if not total:
+        return []
+    return sorted(((step, count * 100.0 / total) for step, count in counts.items()),
+                  key=lambda item: item[1], reverse=True)
+
+def access_direction(access: MemoryAccess) -> Optional[str]:
+    """变量的读写方向：read-only、write-only 或 read-write，没有区分读写时为 None"""
+    if access.loads is None:
+        return None
+    if not access.stores:
+        return 'read-only'
+    if not access.loads:
+        return 'write-only'
+    return 'read-write'
+
+def interchange_hint(access: MemoryAccess) -> Optional[Tuple[int, int]]:
+    """最内层循环走的是跨度大的维时返回 (变化最频繁的维, 最后一维)，否则返回 None"""
+    moves = access.dim_moves
+    if len(moves) < 2 or not access.dim_accesses:
+        return None
+    fast = max(range(len(moves)), key=lambda d: (moves[d], -d))
+    last = len(moves) - 1
+    if (fast != last and moves[last] > 0 and moves[fast] >= moves[last] * INTERCHANGE_RATIO
+            and moves[fast] * 2 >= access.dim_accesses):
+        return fast, last
+    return None
+
+def hot_range(access: MemoryAccess, share: float = HOT_SHARE):
+    """返回覆盖 share 比例访问的最短连续地址范围 (起始地址, 字节数, 百分比)，没有热度直方图时返回 None"""
+    if not access.heat:
+        return None
+    buckets = sorted(access.heat.items())
+    total = sum(count for _, count in buckets)
+    best = None
+    lo = 0
+    covered = 0.0
+    for hi, (start, count) in enumerate(buckets):
+        covered += count
+        while covered - buckets[lo][1] >= total * share:
+            covered -= buckets[lo][1]
+            lo += 1
+        if covered >= total * share:
+            size = start + access.heat_width - buckets[lo][0]
+            if best is None or size < best[1]:
+                best = (buckets[lo][0], size, covered * 100.0 / total)
+    return best
+
 def write_csv(accesses: List[MemoryAccess], output_file: str):
     if not accesses:
         print("警告：没有找到有效的访存分析数据")
@@ -152,8 +661,21 @@ def write_csv(accesses: List[MemoryAccess], output_file: str):
     # 找出最大模式数量
     max_patterns = max(len(access.patterns) for access in accesses)
     
-    # 准备表头
-    headers = ['Variable', 'Function', 'Elements', 'Accesses']
+    # 准备表头，区分读写时在访问次数之后增加读写列
+    kinds = any(access.loads is not None for access in accesses)
+    loops = any(access.loop_line for access in accesses)
+    headers = ['Variable', 'Function'] + (['Loop_Line'] if loops else []) + ['Elements', 'Accesses']
+    if kinds:
+        headers.extend(['Loads', 'Stores', 'Load_Step', 'Store_Step', 'Direction'])
+    runs = any(access.runs for access in accesses)
+    if runs:
+        headers.extend(['Run_Step', 'Run_Mean', 'Run_Max'])
+    dims = any(access.dim_accesses for access in accesses)
+    if dims:
+        headers.extend(['Dim_Changes', 'Interchange'])
+    shares = any(access.share_line for access in accesses)
+    if shares:
+        headers.extend(['Shared_Read', 'Shared_Write', 'False_Sharing'])
     for i in range(max_patterns):
         headers.extend([f'Pattern_{i+1}_Step', f'Pattern_{i+1}_Percentage'])
     
@@ -162,12 +684,30 @@ def write_csv(accesses: List[MemoryAccess], output_file: str):
         writer.writerow(headers)
         
         for access in accesses:
-            row = [
-                access.var_name,
-                access.func_name,
+            row = [access.var_name, access.func_name] + ([access.loop_line or ''] if loops else []) + [
                 access.elements,
                 access.accesses
             ]
+            if kinds:
+                row.extend([
+                    '' if access.loads is None else access.loads,
+                    '' if access.stores is None else access.stores,
+                    access.load_steps[0][0] if access.load_steps else '',
+                    access.store_steps[0][0] if access.store_steps else '',
+                    access_direction(access) or '',
+                ])
+            if runs:
+                row.extend([access.run_step, f"{access.run_total / access.runs:.1f}", access.run_max]
+                           if access.runs else ['', '', ''])
+            if dims:
+                # 由外向内各维下标发生变化的访问占比，以 / 分隔
+                hint = interchange_hint(access)
+                row.extend(['/'.join(f"{moves * 100.0 / access.dim_accesses:.1f}" for moves in access.dim_moves)
+                            if access.dim_accesses else '',
+                            f"{hint[0]}->{hint[1]}" if hint else ''])
+            if shares:
+                row.extend([access.shared_read, access.shared_write, access.false_sharing]
+                           if access.share_line else ['', '', ''])
             
             # 添加模式信息
             for pattern in access.patterns:
@@ -179,12 +719,192 @@ def write_csv(accesses: List[MemoryAccess], output_file: str):
             
             writer.writerow(row)
 
+def write_json(accesses: List[MemoryAccess], output_file: str):
+    records = []
+    for access in accesses:
+        records.append({
+            'variable': access.var_name,
+            'function': access.func_name,
+            'elements': access.elements,
+            'accesses': access.accesses,
+            'exact': access.exact,
+            'patterns': [{
+                'step': pattern.step,
+                'count': round(pattern.access_count),
+                'percentage': round(pattern.percentage, 3),
+                'error_percentage': round(pattern.error, 3),
+            } for pattern in access.patterns],
+            'nested_patterns': [{
+                'step': nested.step,
+                'length': nested.length,
+                'jump': nested.jump,
+                'percentage': round(nested.percentage, 3),
+            } for nested in access.nested],
+        })
+        if access.loop_line:
+            records[-1]['loop_line'] = access.loop_line
+        if access.phases:
+            records[-1]['phases'] = [{
+                'start': phase.start,
+                'accesses': phase.accesses,
+                'irregular': phase.irregular,
+                'span': phase.span,
+                'steps': [{'step': step, 'percentage': round(share, 3)} for step, share in phase.steps],
+            } for phase in access.phases]
+        if access.runs:
+            records[-1]['runs'] = {
+                'step': access.run_step,
+                'count': access.runs,
+                'mean': round(access.run_total / access.runs, 3),
+                'max': access.run_max,
+                'histogram': [{'min_length': low, 'count': round(count)}
+                              for low, count in sorted(access.run_hist.items())],
+            }
+        if access.dim_accesses:
+            records[-1]['dimensions'] = [{
+                'dimension': d,
+                'changes': round(moves),
+                'percentage': round(moves * 100.0 / access.dim_accesses, 3),
+                'steps': [{'step': step, 'count': round(count)}
+                          for step, count in sorted(steps.items(), key=lambda item: item[1], reverse=True)],
+            } for d, (moves, steps) in enumerate(zip(access.dim_moves, access.dim_steps))]
+            hint = interchange_hint(access)
+            if hint:
+                records[-1]['interchange'] = {'innermost': hint[0], 'suggested': hint[1]}
+        if access.share_line:
+            records[-1]['sharing'] = {
+                'line_bytes': access.share_line,
+                'shared_read': access.shared_read,
+                'shared_write': access.shared_write,
+                'false_sharing': access.false_sharing,
+                'false_offsets': access.false_offsets,
+            }
+        if access.reuse_hist or access.reuse_cold:
+            records[-1]['reuse_distance'] = {
+                'histogram': [{'below_bytes': bound, 'count': round(count)}
+                              for bound, count in sorted(access.reuse_hist.items())],
+                'cold': round(access.reuse_cold),
+            }
+        if access.loads is not None:
+            records[-1]['direction'] = access_direction(access)
+            for key, count, steps in (('loads', access.loads, access.load_steps),
+                                      ('stores', access.stores, access.store_steps)):
+                records[-1][key] = {
+                    'count': count,
+                    'steps': [{'step': step, 'percentage': round(share, 3)} for step, share in steps],
+                }
+        if access.cycles:
+            elem_size = access.type_size or ASSUMED_ELEM_SIZE
+            records[-1]['cycles'] = access.cycles
+            records[-1]['bytes_per_cycle'] = round(access.accesses * elem_size / access.cycles, 3)
+        if access.heat:
+            start, size, percentage = hot_range(access)
+            records[-1]['heat_map'] = {
+                'bucket_bytes': access.heat_width,
+                'buckets': [{'address': hex(address), 'count': round(count)}
+                            for address, count in sorted(access.heat.items())],
+                'hot_range': {'address': hex(start), 'bytes': size, 'percentage': round(percentage, 3)},
+            }
+    with open(output_file, 'w') as f:
+        json.dump(records, f, indent=2)
+
+def recommend_transfer(access: MemoryAccess, capacity: int) -> Dict[str, object]:
+    """根据访存范围和主要模式为一个变量推荐 DMA 传输方案。
+
+    capacity 为分给该变量的片上容量（字节），分块传输时按双缓冲各占一半。
+    返回的 scheme 为 contiguous（连续块）、strided（二维跨步）或 gather（逐点收集）。
+    """
+    footprint = access.elements  # 报告中的 elements 为访问范围的字节数
+    elem = access.type_size or ASSUMED_ELEM_SIZE
+    chunk = capacity // 2
+    fits = footprint <= capacity
+    dense = sum(p.percentage for p in access.patterns if abs(p.step) <= DENSE_STRIDE_LIMIT)
+    dominant = max(access.patterns, key=lambda p: p.percentage, default=None)
+    nested = access.nested[0] if access.nested else None
+    hot = hot_range(access)
+
+    # 只写的变量不需要拷入，只读的变量不需要写回；没有区分读写时两个方向都传输
+    direction = access_direction(access)
+    rec = {'variable': access.var_name, 'function': access.func_name, 'footprint': footprint,
+           'inbound': direction != 'write-only', 'outbound': direction != 'read-only'}
+    if fits:
+        # 整个访问范围能放入片上存储时，一次连续传输即可，与访问顺序无关
+        rec.update(scheme='contiguous', chunk=footprint, double_buffer=False,
+                   reason='footprint fits on chip')
+    elif hot and hot[1] <= capacity:
+        # 访问集中在一段能放入片上存储的热区时只拷入热区，其余访问留在主存
+        start, size, percentage = hot
+        rec.update(scheme='contiguous', chunk=size, double_buffer=False,
+                   hot_offset=start - min(access.heat),
+                   reason=f'{percentage:.1f}% of accesses in a {size}B hot range')
+    elif nested and nested.percentage >= 50 and abs(nested.step) <= DENSE_STRIDE_LIMIT:
+        # 每行 length+1 次访问，行间距为行内跨度加上跳转
+        row_elems = (nested.length * abs(nested.step) + 1)
+        row_stride = nested.length * nested.step + nested.jump
+        row_bytes = row_elems * elem
+        rows = max(1, chunk // row_bytes)
+        rec.update(scheme='strided', chunk=rows * row_bytes, double_buffer=True,
+                   row_elements=row_elems, row_stride=row_stride, rows=rows,
+                   reason=f'{nested.percentage:.1f}% of accesses in rows of {row_elems}')
+    elif dense >= 80:
+        rec.update(scheme='contiguous', chunk=chunk, double_buffer=True,
+                   reason=f'{dense:.1f}% of steps within {DENSE_STRIDE_LIMIT} elements')
+    elif dominant and dominant.percentage >= 80:
+        rows = max(1, chunk // elem)
+        rec.update(scheme='strided', chunk=rows * elem, double_buffer=True,
+                   row_elements=1, row_stride=dominant.step, rows=rows,
+                   reason=f'{dominant.percentage:.1f}% of steps are {dominant.step}')
+    else:
+        rec.update(scheme='gather', chunk=chunk, double_buffer=True,
+                   reason='no dominant stride')
+    if rec['double_buffer'] and access.runs and abs(access.run_step) == 1:
+        # 单位步长连续段的平均长度即每次 DMA 突发传输能连续搬运的字节数
+        rec['burst'] = round(access.run_total / access.runs) * elem
+    return rec
+
+def write_dma_report(accesses: List[MemoryAccess], output_file: str, spm_size: int):
+    # 同一函数（区分循环时为同一循环）中的变量平分片上容量
+    per_function = defaultdict(int)
+    for access in accesses:
+        per_function[(access.func_name, access.loop_line)] += 1
+    
+    with open(output_file, 'w') as f:
+        f.write(f"# DMA transfer recommendations (on-chip capacity {spm_size} bytes)\n")
+        for access in accesses:
+            capacity = spm_size // per_function[(access.func_name, access.loop_line)]
+            rec = recommend_transfer(access, capacity)
+            site = f" (loop at line {access.loop_line})" if access.loop_line else ""
+            f.write(f"{rec['function']}/{rec['variable']}{site}: {rec['scheme']}, "
+                    f"footprint={rec['footprint']}B, chunk={rec['chunk']}B")
+            if rec['double_buffer']:
+                f.write(", double-buffered")
+            if 'hot_offset' in rec:
+                f.write(f", hot range only at +{rec['hot_offset']}B")
+            if not rec['inbound']:
+                f.write(", write-back only (write-only, no fetch)")
+            elif not rec['outbound']:
+                f.write(", fetch only (read-only, no write-back)")
+            if 'burst' in rec:
+                f.write(f", mean burst={rec['burst']}B")
+            if rec['scheme'] == 'strided':
+                f.write(f", {rec['rows']} x {rec['row_elements']} elements, row stride={rec['row_stride']}")
+            if access.false_sharing:
+                # 各线程写回的块共用行时，按行大小对齐各线程负责的块
+                f.write(f", {access.false_sharing} falsely shared {access.share_line}B lines"
+                        f" (align per-thread blocks to {access.share_line}B)")
+            f.write(f" ({rec['reason']})\n")
+
 def main():
-    if len(sys.argv) != 2:
-        print("使用方法: python3 analyze_memory.py <input_file>")
-        sys.exit(1)
+    parser = argparse.ArgumentParser(description='汇总 MemProfMT 插桩程序输出的访存分析结果')
+    parser.add_argument('input_file', help='程序输出（文本报告、[Memory Profile] 记录或二进制记录文件）')
+    parser.add_argument('--format', choices=['csv', 'json', 'dma'], default='csv',
+                        help='输出格式，dma 为按变量推荐的 DMA 传输方案')
+    parser.add_argument('--spm-size', type=int, default=DEFAULT_SPM_SIZE,
+                        help='DMA 方案可用的片上存储字节数（默认 %(default)s）')
+    parser.add_argument('-o', '--output', help='输出文件名，默认为 memory_analysis.<format>')
+    args = parser.parse_args()
     
-    input_file = sys.argv[1]
+    input_file = args.input_file
     
     try:
         # 解析内存分析输出
@@ -197,9 +917,15 @@ def main():
         # 合并结果
         merged_results = merge_memory_analysis(accesses)
         
-        # 写入CSV
-        output_file = "memory_analysis.csv"
-        write_csv(merged_results, output_file)
+        # 写入CSV、JSON或DMA传输方案
+        extension = "txt" if args.format == "dma" else args.format
+        output_file = args.output or f"memory_analysis.{extension}"
+        if args.format == 'json':
+            write_json(merged_results, output_file)
+        elif args.format == 'dma':
+            write_dma_report(merged_results, output_file, args.spm_size)
+        else:
+            write_csv(merged_results, output_file)
         
         print(f"\n分析完成. 结果已写入 {output_file}")
         
@@ -5,6 +5,46 @@
 #include <vector> 
 #include <string> 
 
+// 插桩代码运行的目标平台
+enum class ProfilerBackend
+{
+    Device,  // MT3000 加速器（hthread）
+    Pthread, // Linux 主机，pthreads 线程
+    OpenMP   // Linux 主机，OpenMP 线程
+};
+
+// 分析结果的输出格式
+enum class OutputFormat
+{
+    Text,  // [Memory Analysis] 文本报告
+    Binary // [Memory Profile] 二进制记录
+};
+
+// 运行时代码生成配置
+struct ProfilerConfig
+{
+    ProfilerBackend backend = ProfilerBackend::Device;
+    unsigned samplePeriod = 1; // 采样周期，1 表示记录全部访问
+    unsigned sampleBurst = 1;  // 每个采样周期内连续记录的访问次数
+    bool affineSummary = true; // 仿射循环访问在循环前插入一次摘要记录
+    unsigned batchSize = 0;    // 访问地址批量处理的缓冲区长度，0 表示逐次处理
+    OutputFormat outputFormat = OutputFormat::Text;
+    unsigned reduceThreads = 0; // 函数退出时归约的线程数，0 表示各线程分别输出
+    bool reuseDistance = false; // 统计缓存行粒度的重用距离直方图
+    bool runtimeLibrary = false; // 只包含 mem_profiler.h，调用单独编译的运行时库
+    bool accumulate = false;     // 分析结果存放在各插桩点的静态存储中，跨调用累积
+    std::vector<std::string> reportFunctions; // 累积模式下退出时输出当前线程累积结果的函数
+    bool compactProfile = false; // 紧凑布局：名称只保存指针，步长与计数使用32位
+    bool heatMap = false;        // 统计每个变量访问范围内的分桶访问热度
+    unsigned phaseWindow = 0;    // 每个窗口分析的访问次数，0 表示不划分阶段
+    bool timing = false;         // 统计插桩函数的周期数并换算每周期访问字节数
+    bool loadStore = false;      // 按读写类别分别统计访问次数与步长
+    bool runLengths = false;     // 统计主要步长连续段长度的对数分桶直方图
+    bool dimStrides = false;     // 多维数组按维统计下标的变化，提示交换循环
+    bool loopSites = false;      // 每个循环中的访问单独分析，访问次数多的循环先输出
+    bool sharing = false;        // 合并线程结果时按缓存行比较各线程的读写，报告共享与伪共享
+};
+
 // 内存访问分析代码生成器
 class MemoryCodeGenerator
 {
@@ -14,9 +54,10 @@ public:
     constexpr static unsigned MAX_PATTERNS = 16;     // 记录的最大访存模式数
     constexpr static unsigned NAME_SIZE = 64;        // 名称最大长度
     constexpr static unsigned PATTERN_THRESHOLD = 5; // 访存模式识别阈值(%)
+    constexpr static unsigned MAX_DIMS = 4;          // 分维统计的最大维数
 
     // 生成访存分析的基本数据结构
-    static std::string generateBaseStructures(const std::vector<std::string> &includes)
+    static std::string generateBaseStructures(const std::vector<std::string> &includes, const ProfilerConfig &config)
     {
         std::stringstream ss;
 
@@ -37,32 +78,452 @@ public:
             ss << "#include <stdio.h>\n";
         if (!hasString)
             ss << "#include <string.h>\n";
-        if (!hasHthreadDevice)
-            ss << "#include \"hthread_device.h\"\n";
 
-        // 定义常量
         ss << "#ifndef MEM_PROFILER_DEFS\n"
-           << "#define MEM_PROFILER_DEFS\n"
-           << "#define MEM_MAX_PATTERNS " << MAX_PATTERNS << "\n"
+           << "#define MEM_PROFILER_DEFS\n";
+        ss << generateParameters(config);
+        ss << generateBackend(config, hasHthreadDevice);
+        ss << generateReduction(config);
+        ss << generateReuseDistance(config);
+        ss << generateHeatMap(config);
+        ss << generatePhases(config);
+        ss << generateTiming(config);
+        ss << generateLoadStore(config);
+        ss << generateRunLengths(config);
+        ss << generateDimStrides(config);
+        ss << generateLoopSites(config);
+        ss << generateSharing(config);
+        ss << generateDataStructures();
+        ss << "#endif // MEM_PROFILER_DEFS\n\n";
+
+        return ss.str();
+    }
+
+    // 生成常量与编译期参数定义
+    static std::string generateParameters(const ProfilerConfig &config)
+    {
+        std::stringstream ss;
+
+        // 定义常量
+        ss << "#define MEM_MAX_PATTERNS " << MAX_PATTERNS << "\n"
            << "#define MEM_NAME_SIZE " << NAME_SIZE << "\n"
+           << "#ifndef MEM_NUM_THREADS\n"
            << "#define MEM_NUM_THREADS " << NUM_THREADS << "\n"
-           << "#define MEM_TOP_PATTERNS 3\n\n";
+           << "#endif\n"
+           << "#define MEM_TOP_PATTERNS 3\n"
+           << "#define MEM_MAX_NESTED 4\n"
+           << "#ifndef MEM_COMPACT\n"
+           << "#define MEM_COMPACT " << (config.compactProfile ? 1 : 0) << "\n"
+           << "#endif\n"
+           << "// 紧凑布局的步长与计数为32位，计数将要溢出时该分析结果的全部计数减半\n"
+           << "#if MEM_COMPACT\n"
+           << "typedef int mem_step_t;\n"
+           << "typedef unsigned int mem_count_t;\n"
+           << "#define MEM_STEP_MAX ((long)(~0U >> 1))\n"
+           << "#define MEM_COUNT_MAX (~0U)\n"
+           << "#define MEM_EMPTY_PATTERN (-(int)(~0U >> 1) - 1) // INT_MIN，不会作为真实步长出现\n"
+           << "#else\n"
+           << "typedef long mem_step_t;\n"
+           << "typedef size_t mem_count_t;\n"
+           << "#define MEM_EMPTY_PATTERN (-(long)(~0UL >> 1) - 1) // LONG_MIN，不会作为真实步长出现\n"
+           << "#endif\n"
+           << "// 步长散列到模式表中的起始探测位置\n"
+           << "#define MEM_PATTERN_HASH(step) \\\n"
+           << "    (int)((unsigned)(((unsigned long long)(step) * 0x9E3779B97F4A7C15ULL) >> 32) % MEM_MAX_PATTERNS)\n\n";
+
+        ss << generateSampling(config);
+        ss << generateBatching(config);
+        ss << generateOutputFormat(config);
+        return ss.str();
+    }
 
-        // 定义数据结构
-        ss << "typedef struct {\n"
-           << "    char var_name[MEM_NAME_SIZE];            // 变量名\n"
-           << "    char func_name[MEM_NAME_SIZE];           // 所在函数名\n"
+    // 生成分析器的数据结构，依赖编译期参数中的数组长度
+    static std::string generateDataStructures()
+    {
+        std::stringstream ss;
+        ss << "#if MEM_PHASE_WINDOW > 0\n"
+           << "// 一个访问阶段：主要步长相同的连续窗口合并而成\n"
+           << "typedef struct {\n"
+           << "    size_t start;                       // 阶段开始时的访问次数\n"
+           << "    size_t accesses;                    // 阶段内的访问次数\n"
+           << "    size_t analyzed;                    // 阶段内被分析的步长数（采样时只含被采样的访问）\n"
+           << "    size_t low, high;                   // 阶段内的访问地址范围\n"
+           << "    mem_step_t steps[MEM_PHASE_TOP];    // 阶段内最频繁的步长\n"
+           << "    mem_count_t counts[MEM_PHASE_TOP];  // 各步长在阶段内的次数\n"
+           << "} mem_phase_t;\n"
+           << "#endif\n\n"
+           << "typedef struct {\n"
+           << "    // 每次访问都要读写的字段放在开头，紧凑布局下共占一个64字节缓存行\n"
+           << "    size_t last_addr;                 // 上次访问地址\n"
            << "    size_t base_addr;                 // 变量基地址\n"
            << "    size_t end_addr;                  // 变量访存范围结尾地址\n"
            << "    size_t total_accesses;            // 总访问次数\n"
-           << "    size_t patterns[MEM_MAX_PATTERNS];       // 访存步长模式\n"
-           << "    size_t pattern_counts[MEM_MAX_PATTERNS]; // 各模式出现次数\n"
-           << "    size_t last_addr;                 // 上次访问地址\n"
+           << "    size_t sampled_accesses;          // 被采样分析的访问次数\n"
+           << "    size_t run_len;                   // 当前步长已连续出现的次数\n"
+           << "    mem_step_t run_step;              // 当前连续相同的步长\n"
+           << "    unsigned sample_phase;            // 当前访问在采样周期中的位置\n"
+           << "    unsigned type_size;               // 变量类型大小\n"
+           << "    int last_pattern;                 // 上次命中的模式表位置\n"
+           << "    mem_step_t patterns[MEM_MAX_PATTERNS];         // 访存步长模式（带符号，负数为反向访问）\n"
+           << "    mem_count_t pattern_counts[MEM_MAX_PATTERNS];  // 各模式出现次数（上界估计）\n"
+           << "    mem_count_t pattern_errors[MEM_MAX_PATTERNS];  // 各模式计数的最大高估量\n"
+           << "#if MEM_SAMPLE_PERIOD > 1\n"
+           << "    mem_count_t pattern_exact[MEM_MAX_PATTERNS];   // 各模式计数中来自仿射摘要的部分，不按采样率还原\n"
+           << "    size_t exact_accesses;            // 仿射摘要记录的访问次数，计入总次数但不计入采样次数\n"
+           << "#endif\n"
+           << "    mem_step_t nested_steps[MEM_MAX_NESTED];       // 嵌套模式的内层步长\n"
+           << "    size_t nested_lens[MEM_MAX_NESTED];            // 内层步长连续出现的次数\n"
+           << "    mem_step_t nested_jumps[MEM_MAX_NESTED];       // 内层结束后的跳转步长\n"
+           << "    mem_count_t nested_counts[MEM_MAX_NESTED];     // 嵌套模式出现次数（上界估计）\n"
            << "    size_t var_size;                  // 变量大小\n"
-           << "    size_t type_size;                 // 变量类型大小\n"
+           << "    int merged_threads;               // 归约进来的线程数，0 表示单线程结果\n"
+           << "#if MEM_COMPACT\n"
+           << "    const char* var_name;             // 变量名，指向插桩时生成的字符串常量\n"
+           << "    const char* func_name;            // 所在函数名\n"
+           << "#else\n"
+           << "    char var_name[MEM_NAME_SIZE];     // 变量名\n"
+           << "    char func_name[MEM_NAME_SIZE];    // 所在函数名\n"
+           << "#endif\n"
+           << "#if MEM_REUSE_DISTANCE\n"
+           << "    size_t reuse_lines[MEM_REUSE_LINES];     // 被采样跟踪的缓存行\n"
+           << "    unsigned reuse_hashes[MEM_REUSE_LINES];  // 各缓存行的散列值\n"
+           << "    unsigned short reuse_times[MEM_REUSE_LINES];       // 各缓存行最近一次访问在窗口中的时刻\n"
+           << "    unsigned short reuse_owner[MEM_REUSE_WINDOW + 1];  // 各时刻对应的表项下标+1，0为空\n"
+           << "    unsigned short reuse_tree[MEM_REUSE_WINDOW + 1];   // 按时刻统计被跟踪行数的树状数组\n"
+           << "    unsigned short reuse_index[MEM_REUSE_INDEX];       // 行地址散列索引，存表项下标+1\n"
+           << "    int reuse_count;                         // 已跟踪的缓存行数\n"
+           << "    unsigned reuse_threshold;                // 散列值小于阈值的缓存行被跟踪\n"
+           << "    size_t reuse_clock;                      // 窗口中最近一次被跟踪访问的时刻\n"
+           << "    size_t reuse_hist[MEM_REUSE_BINS + 1];   // 重用距离直方图，最后一格为首次访问\n"
+           << "#endif\n"
+           << "#if MEM_HEAT_MAP\n"
+           << "    size_t heat_base;                 // 热度直方图第一个桶的起始地址，按桶宽对齐\n"
+           << "    unsigned heat_shift;              // 桶宽为2^heat_shift字节\n"
+           << "    size_t heat[MEM_HEAT_BINS];       // 各桶被分析的访问次数\n"
+           << "#endif\n"
+           << "#if MEM_PHASE_WINDOW > 0\n"
+           << "    size_t phase_start;               // 当前窗口开始时的访问次数\n"
+           << "    size_t phase_low, phase_high;     // 当前窗口的访问地址范围\n"
+           << "    size_t phase_analyzed;            // 当前窗口中被分析的步长数\n"
+           << "    mem_step_t phase_steps[MEM_MAX_PATTERNS];   // 窗口开始时的模式表快照\n"
+           << "    mem_count_t phase_counts[MEM_MAX_PATTERNS];\n"
+           << "    mem_phase_t phases[MEM_MAX_PHASES];         // 最近的阶段，环形存放\n"
+           << "    int phase_count;                  // 已记录的阶段总数\n"
+           << "#endif\n"
+           << "#if MEM_RUN_LENGTHS\n"
+           << "    mem_step_t run_hist_step;         // 直方图跟踪的步长，取最频繁的步长\n"
+           << "    size_t runs;                      // 该步长的连续段数\n"
+           << "    size_t run_total;                 // 各段元素数之和\n"
+           << "    size_t run_max;                   // 最长一段的元素数\n"
+           << "    size_t run_hist[MEM_RUN_BINS];    // 第k格为元素数在[2^k, 2^(k+1))内的段数，最后一格不设上限\n"
+           << "#endif\n"
+           << "#if MEM_DIM_STRIDES\n"
+           << "    int dims;                         // 多维下标访问的维数，0 表示没有\n"
+           << "    size_t dim_accesses;              // 多维下标访问的次数\n"
+           << "    long dim_last[MEM_MAX_DIMS];      // 上次访问的各维下标\n"
+           << "    size_t dim_moves[MEM_MAX_DIMS];   // 各维下标发生变化的次数\n"
+           << "    long dim_steps[MEM_MAX_DIMS][MEM_DIM_PATTERNS];    // 各维最频繁的下标变化\n"
+           << "    size_t dim_counts[MEM_MAX_DIMS][MEM_DIM_PATTERNS]; // 各下标变化的次数，0 表示空表项\n"
+           << "#endif\n"
+           << "#if MEM_LOOP_SITES\n"
+           << "    unsigned loop_line;               // 所在循环的起始行号，0 表示函数中循环以外的访问\n"
+           << "#endif\n"
+           << "#if MEM_SHARING\n"
+           << "    size_t share_lines[MEM_SHARE_LINES];              // 被采样跟踪的行\n"
+           << "    unsigned long long share_reads[MEM_SHARE_LINES];  // 各行被读的字节掩码\n"
+           << "    unsigned long long share_writes[MEM_SHARE_LINES]; // 各行被写的字节掩码\n"
+           << "    unsigned share_hashes[MEM_SHARE_LINES];           // 各行的散列值\n"
+           << "    unsigned char share_flags[MEM_SHARE_LINES];       // 合并线程结果时发现的共享类别\n"
+           << "    int share_count;                  // 已跟踪的行数\n"
+           << "    int share_last;                   // 最近访问的表项，连续访问同一行时不必查找\n"
+           << "    unsigned share_threshold;         // 散列值小于阈值的行被跟踪\n"
+           << "#endif\n"
+           << "#if MEM_LOAD_STORE\n"
+           << "    size_t kind_accesses[2];          // 读、写各自的次数\n"
+           << "    size_t kind_last[2];              // 读、写各自上次访问的地址\n"
+           << "    long kind_steps[2][MEM_KIND_PATTERNS];    // 读、写各自最频繁的步长\n"
+           << "    size_t kind_counts[2][MEM_KIND_PATTERNS]; // 各步长的次数，0 表示空表项\n"
+           << "#endif\n"
+           << "#if MEM_TIMING\n"
+           << "    unsigned long long cycles;        // 所在函数累计的周期数\n"
+           << "    size_t timed_accesses;            // 上次计时时的访问次数\n"
+           << "#endif\n"
+           << "#if MEM_BATCH_SIZE > 0\n"
+           << "    size_t batch[MEM_BATCH_SIZE];     // 待批量处理的访问地址\n"
+           << "    size_t batch_len;                 // 缓冲区中的地址个数\n"
+           << "#endif\n"
            << "} mem_profile_t;\n\n"
-           << "#endif // MEM_PROFILER_DEFS\n\n";
+           << "// 线程间共享的归约结果\n"
+           << "typedef struct {\n"
+           << "    mem_profile_t prof;               // 已合并的分析结果\n"
+           << "    int arrivals;                     // 本轮已到达的线程数\n"
+           << "    volatile int lock;\n"
+           << "} mem_shared_profile_t;\n\n"
+           << "// 一次函数调用的计时：函数入口开始计时，退出时把周期数分给函数内的各变量\n"
+           << "typedef struct {\n"
+           << "    const char* func_name;\n"
+           << "    unsigned long long start;         // 入口处的周期计数\n"
+           << "    unsigned long long cycles;        // 本次调用的周期数\n"
+           << "    size_t bytes;                     // 本次调用中各变量访问的字节数\n"
+           << "} mem_region_t;\n\n"
+           << "// 累积模式下一个插桩点的分析结果：每个线程一份，首次使用时登记到全局表\n"
+           << "typedef struct mem_site {\n"
+           << "    mem_profile_t profs[MEM_NUM_THREADS];\n"
+           << "    unsigned char ready[MEM_NUM_THREADS]; // 该线程的结果是否已初始化\n"
+           << "    volatile int registered;\n"
+           << "    struct mem_site* next;\n"
+           << "} mem_site_t;\n\n";
+        return ss.str();
+    }
+
+    // 生成平台相关的线程号与输出接口，可在编译时通过 -DMEM_BACKEND=<n> 覆盖
+    static std::string generateBackend(const ProfilerConfig &config, bool hasHthreadDevice)
+    {
+        std::stringstream ss;
+        ss << "#define MEM_BACKEND_DEVICE 0\n"
+           << "#define MEM_BACKEND_PTHREAD 1\n"
+           << "#define MEM_BACKEND_OPENMP 2\n"
+           << "#ifndef MEM_BACKEND\n"
+           << "#define MEM_BACKEND " << static_cast<int>(config.backend) << "\n"
+           << "#endif\n\n";
+
+        ss << "#if MEM_BACKEND == MEM_BACKEND_DEVICE\n";
+        if (!hasHthreadDevice)
+            ss << "#include \"hthread_device.h\"\n";
+        ss << "#define __mem_thread_id() get_thread_id()\n"
+           << "#define __mem_printf hthread_printf\n"
+           << "#elif MEM_BACKEND == MEM_BACKEND_OPENMP\n"
+           << "#include <omp.h>\n"
+           << "#include <stdlib.h>\n"
+           << "#define __mem_thread_id() (omp_get_thread_num() % MEM_NUM_THREADS)\n"
+           << "#define __mem_printf printf\n"
+           << "#else\n"
+           << "#include <pthread.h>\n"
+           << "#include <stdlib.h>\n"
+           << "// 主机线程首次访问时按到达顺序分配线程号。计数器与线程号为弱定义，内嵌运行时的各翻译单元\n"
+           << "// 链接后共用同一份，同一线程在各文件的报告中线程号相同\n"
+           << "__attribute__((weak)) int __mem_thread_counter = 0;\n"
+           << "__attribute__((weak)) __thread int __mem_tid = -1;\n"
+           << "static inline int __mem_thread_id(void) {\n"
+           << "    if (__mem_tid < 0)\n"
+           << "        __mem_tid = __atomic_fetch_add(&__mem_thread_counter, 1, __ATOMIC_RELAXED) % MEM_NUM_THREADS;\n"
+           << "    return __mem_tid;\n"
+           << "}\n"
+           << "#define __mem_printf printf\n"
+           << "#endif\n\n"
+           << "// 周期计数：MT-3000 读取 DSP 时钟，x86 主机读取时间戳计数器，其他主机使用纳秒时钟\n"
+           << "#ifndef MEM_CYCLES\n"
+           << "#if MEM_BACKEND == MEM_BACKEND_DEVICE\n"
+           << "#define MEM_CYCLES() get_clk()\n"
+           << "#elif defined(__x86_64__) || defined(__i386__)\n"
+           << "#define MEM_CYCLES() __builtin_ia32_rdtsc()\n"
+           << "#else\n"
+           << "#include <time.h>\n"
+           << "static inline unsigned long long __mem_clock_ns(void) {\n"
+           << "    struct timespec ts;\n"
+           << "    clock_gettime(CLOCK_MONOTONIC, &ts);\n"
+           << "    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;\n"
+           << "}\n"
+           << "#define MEM_CYCLES() __mem_clock_ns()\n"
+           << "#endif\n"
+           << "#endif\n\n";
+        return ss.str();
+    }
+
+    // 生成线程归约参数。MEM_SHARED 指定共享结果的存放位置（例如 MT3000 上的 GSM），
+    // MEM_LOCK/MEM_UNLOCK 默认使用原子自旋锁，均可在编译时覆盖
+    static std::string generateReduction(const ProfilerConfig &config)
+    {
+        std::stringstream ss;
+        ss << "#ifndef MEM_REDUCE_THREADS\n"
+           << "#define MEM_REDUCE_THREADS " << (config.reduceThreads ? config.reduceThreads : 1) << "\n"
+           << "#endif\n"
+           << "#ifndef MEM_SHARED\n"
+           << "#define MEM_SHARED\n"
+           << "#endif\n"
+           << "#ifndef MEM_LOCK\n"
+           << "#define MEM_LOCK(lock) while (__sync_lock_test_and_set(lock, 1)) {}\n"
+           << "#define MEM_UNLOCK(lock) __sync_lock_release(lock)\n"
+           << "#endif\n\n";
+        return ss.str();
+    }
+
+    // 生成重用距离统计参数，可在编译时通过 -DMEM_LINE_SIZE/-DMEM_REUSE_LINES 调整
+    static std::string generateReuseDistance(const ProfilerConfig &config)
+    {
+        std::stringstream ss;
+        ss << "#ifndef MEM_REUSE_DISTANCE\n"
+           << "#define MEM_REUSE_DISTANCE " << (config.reuseDistance ? 1 : 0) << "\n"
+           << "#endif\n"
+           << "#ifndef MEM_LINE_SIZE\n"
+           << "#define MEM_LINE_SIZE 64\n"
+           << "#endif\n"
+           << "#ifndef MEM_REUSE_LINES\n"
+           << "#define MEM_REUSE_LINES 128\n"
+           << "#endif\n"
+           << "#define MEM_REUSE_BINS 24\n"
+           << "#define MEM_REUSE_SCALE (1U << 24)\n"
+           << "// 访问时刻窗口与行地址散列索引的大小；表项以unsigned short存放，MEM_REUSE_LINES不超过32767\n"
+           << "#define MEM_REUSE_WINDOW (2 * MEM_REUSE_LINES)\n"
+           << "#define MEM_REUSE_INDEX (2 * MEM_REUSE_LINES)\n"
+           << "#if MEM_REUSE_DISTANCE && MEM_REUSE_LINES > 32767\n"
+           << "#error MEM_REUSE_LINES must not exceed 32767\n"
+           << "#endif\n\n";
+        return ss.str();
+    }
+
+    // 生成访问热度直方图参数，可在编译时通过 -DMEM_HEAT_BINS 调整桶数
+    static std::string generateHeatMap(const ProfilerConfig &config)
+    {
+        std::stringstream ss;
+        ss << "#ifndef MEM_HEAT_MAP\n"
+           << "#define MEM_HEAT_MAP " << (config.heatMap ? 1 : 0) << "\n"
+           << "#endif\n"
+           << "#ifndef MEM_HEAT_BINS\n"
+           << "#define MEM_HEAT_BINS 32\n"
+           << "#endif\n"
+           << "#define MEM_HEAT_HOT 90 // 报告中热区覆盖的访问百分比\n\n";
+        return ss.str();
+    }
+
+    // 生成阶段划分参数，可在编译时通过 -DMEM_PHASE_WINDOW/-DMEM_MAX_PHASES 覆盖
+    static std::string generatePhases(const ProfilerConfig &config)
+    {
+        std::stringstream ss;
+        ss << "#ifndef MEM_PHASE_WINDOW\n"
+           << "#define MEM_PHASE_WINDOW " << config.phaseWindow << "\n"
+           << "#endif\n"
+           << "#ifndef MEM_MAX_PHASES\n"
+           << "#define MEM_MAX_PHASES 8\n"
+           << "#endif\n"
+           << "#define MEM_PHASE_TOP 2\n\n";
+        return ss.str();
+    }
+
+    // 生成计时参数，可在编译时通过 -DMEM_CYCLES=<表达式> 指定周期计数的读取方式
+    static std::string generateTiming(const ProfilerConfig &config)
+    {
+        std::stringstream ss;
+        ss << "#ifndef MEM_TIMING\n"
+           << "#define MEM_TIMING " << (config.timing ? 1 : 0) << "\n"
+           << "#endif\n\n";
+        return ss.str();
+    }
+
+    // 生成读写分类参数。访问类别常量总是定义，区分读写的插桩代码在关闭统计时仍可编译
+    static std::string generateLoadStore(const ProfilerConfig &config)
+    {
+        std::stringstream ss;
+        ss << "#ifndef MEM_LOAD_STORE\n"
+           << "#define MEM_LOAD_STORE " << (config.loadStore ? 1 : 0) << "\n"
+           << "#endif\n"
+           << "#define MEM_LOAD 0   // 读\n"
+           << "#define MEM_STORE 1  // 写\n"
+           << "#define MEM_UPDATE 2 // 读改写（复合赋值、自增自减），同时计为一次读和一次写\n"
+           << "#define MEM_KIND_PATTERNS 4\n\n";
+        return ss.str();
+    }
+
+    // 生成连续段长度统计参数，可在编译时通过 -DMEM_RUN_BINS 调整分桶数
+    static std::string generateRunLengths(const ProfilerConfig &config)
+    {
+        std::stringstream ss;
+        ss << "#ifndef MEM_RUN_LENGTHS\n"
+           << "#define MEM_RUN_LENGTHS " << (config.runLengths ? 1 : 0) << "\n"
+           << "#endif\n"
+           << "#ifndef MEM_RUN_BINS\n"
+           << "#define MEM_RUN_BINS 24\n"
+           << "#endif\n\n";
+        return ss.str();
+    }
+
+    // 生成分维统计参数。插桩代码在多维数组的每次访问后调用 __mem_index，关闭统计时该调用为空
+    static std::string generateDimStrides(const ProfilerConfig &config)
+    {
+        std::stringstream ss;
+        ss << "#ifndef MEM_DIM_STRIDES\n"
+           << "#define MEM_DIM_STRIDES " << (config.dimStrides ? 1 : 0) << "\n"
+           << "#endif\n"
+           << "#define MEM_MAX_DIMS " << MAX_DIMS << "\n"
+           << "#define MEM_DIM_PATTERNS 4\n\n";
+        return ss.str();
+    }
+
+    // 生成循环级分析参数。插桩代码为循环中访问的每个变量另建一份分析结果，并用 __mem_loop 记下循环的行号
+    static std::string generateLoopSites(const ProfilerConfig &config)
+    {
+        std::stringstream ss;
+        ss << "#ifndef MEM_LOOP_SITES\n"
+           << "#define MEM_LOOP_SITES " << (config.loopSites ? 1 : 0) << "\n"
+           << "#endif\n\n";
+        return ss.str();
+    }
+
+    // 生成线程间共享统计参数，可在编译时通过 -DMEM_SHARE_LINE/-DMEM_SHARE_LINES 调整比较的粒度
+    // （缓存行或DMA块的字节数）与每个变量跟踪的行数
+    static std::string generateSharing(const ProfilerConfig &config)
+    {
+        std::stringstream ss;
+        ss << "#ifndef MEM_SHARING\n"
+           << "#define MEM_SHARING " << (config.sharing ? 1 : 0) << "\n"
+           << "#endif\n"
+           << "#ifndef MEM_SHARE_LINE\n"
+           << "#define MEM_SHARE_LINE 64\n"
+           << "#endif\n"
+           << "#ifndef MEM_SHARE_LINES\n"
+           << "#define MEM_SHARE_LINES 128\n"
+           << "#endif\n"
+           << "#define MEM_SHARE_SCALE (1U << 24)\n"
+           << "#define MEM_SHARE_GRAIN ((MEM_SHARE_LINE + 63) / 64) // 字节掩码每一位代表的字节数\n"
+           << "#define MEM_SHARE_TOP 4 // 报告中列出的伪共享行数\n"
+           << "#define MEM_SHARED_READ 1   // 多个线程读同一字节\n"
+           << "#define MEM_SHARED_WRITE 2  // 一个线程写、其他线程读写同一字节\n"
+           << "#define MEM_FALSE_SHARING 4 // 一个线程写、其他线程访问同一行中的其他字节\n\n";
+        return ss.str();
+    }
+
+    // 生成采样参数，可在编译时通过 -DMEM_SAMPLE_PERIOD/-DMEM_SAMPLE_BURST 覆盖
+    static std::string generateSampling(const ProfilerConfig &config)
+    {
+        // 突发长度不小于周期时等价于全量记录
+        unsigned period = config.sampleBurst < config.samplePeriod ? config.samplePeriod : 1;
+        unsigned burst = period > 1 ? config.sampleBurst : 1;
+
+        std::stringstream ss;
+        ss << "#ifndef MEM_SAMPLE_PERIOD\n"
+           << "#define MEM_SAMPLE_PERIOD " << period << "\n"
+           << "#endif\n"
+           << "#ifndef MEM_SAMPLE_BURST\n"
+           << "#define MEM_SAMPLE_BURST " << burst << "\n"
+           << "#endif\n\n";
+        return ss.str();
+    }
+
+    // 生成批量处理参数，可在编译时通过 -DMEM_BATCH_SIZE 覆盖
+    static std::string generateBatching(const ProfilerConfig &config)
+    {
+        std::stringstream ss;
+        ss << "#ifndef MEM_BATCH_SIZE\n"
+           << "#define MEM_BATCH_SIZE " << config.batchSize << "\n"
+           << "#endif\n\n";
+        return ss.str();
+    }
 
+    // 生成输出格式选择，可在编译时通过 -DMEM_OUTPUT_FORMAT=<n> 覆盖
+    static std::string generateOutputFormat(const ProfilerConfig &config)
+    {
+        std::stringstream ss;
+        ss << "#define MEM_OUTPUT_TEXT 0\n"
+           << "#define MEM_OUTPUT_BINARY 1\n"
+           << "#ifndef MEM_OUTPUT_FORMAT\n"
+           << "#define MEM_OUTPUT_FORMAT " << static_cast<int>(config.outputFormat) << "\n"
+           << "#endif\n"
+           << "#define MEM_DUMP_MAGIC 0x4652504DU // \"MPRF\"\n"
+           << "#define MEM_DUMP_VERSION 11\n"
+           << "#define MEM_DUMP_MAX (190 + 2 * MEM_NAME_SIZE + 24 * MEM_MAX_PATTERNS + 32 * MEM_MAX_NESTED + \\\n"
+           << "                      8 * MEM_HEAT_BINS + (40 + 16 * MEM_PHASE_TOP) * MEM_MAX_PHASES + 32 * MEM_KIND_PATTERNS + \\\n"
+           << "                      8 * MEM_RUN_BINS + (8 + 16 * MEM_DIM_PATTERNS) * MEM_MAX_DIMS + 8 * MEM_SHARE_TOP + \\\n"
+           << "                      8 * (MEM_REUSE_BINS + 1))\n\n";
         return ss.str();
     }
 
@@ -71,21 +532,115 @@ public:
     {
         std::stringstream ss;
         ss << "// 初始化访存分析器\n"
-           << "static inline void __mem_init(mem_profile_t* prof,\n"
-           << "                             const char* var_name,\n"
-           << "                             const char* func_name,\n"
-           << "                             void* addr,\n"
-           << "                             size_t type_size) {\n"
+           << "MEM_API void __mem_init(mem_profile_t* prof,\n"
+           << "                        const char* var_name,\n"
+           << "                        const char* func_name,\n"
+           << "                        void* addr,\n"
+           << "                        size_t type_size) {\n"
+           << "#if MEM_COMPACT\n"
+           << "    prof->var_name = var_name;\n"
+           << "    prof->func_name = func_name;\n"
+           << "#else\n"
            << "    strncpy(prof->var_name, var_name, MEM_NAME_SIZE-1);\n"
            << "    strncpy(prof->func_name, func_name, MEM_NAME_SIZE-1);\n"
+           << "#endif\n"
            << "    prof->base_addr = (size_t)addr;\n"
            << "    prof->end_addr = prof->base_addr;\n"
            << "    prof->total_accesses = 0;\n"
+           << "    prof->sampled_accesses = 0;\n"
+           << "    prof->sample_phase = 0;\n"
            << "    prof->last_addr = prof->base_addr;\n"
            << "    prof->var_size = 0;\n"
            << "    prof->type_size = type_size;\n"
-           << "    memset(prof->patterns, -1, sizeof(prof->patterns));\n"
+           << "    prof->merged_threads = 0;\n"
+           << "#if MEM_REUSE_DISTANCE\n"
+           << "    prof->reuse_count = 0;\n"
+           << "    prof->reuse_threshold = MEM_REUSE_SCALE;\n"
+           << "    prof->reuse_clock = 0;\n"
+           << "    memset(prof->reuse_owner, 0, sizeof(prof->reuse_owner));\n"
+           << "    memset(prof->reuse_tree, 0, sizeof(prof->reuse_tree));\n"
+           << "    memset(prof->reuse_index, 0, sizeof(prof->reuse_index));\n"
+           << "    memset(prof->reuse_hist, 0, sizeof(prof->reuse_hist));\n"
+           << "#endif\n"
+           << "#if MEM_HEAT_MAP\n"
+           << "    // 初始桶宽不小于一个元素，从变量地址开始\n"
+           << "    prof->heat_shift = 0;\n"
+           << "    while (((size_t)1 << prof->heat_shift) < type_size)\n"
+           << "        prof->heat_shift++;\n"
+           << "    prof->heat_base = prof->base_addr >> prof->heat_shift << prof->heat_shift;\n"
+           << "    memset(prof->heat, 0, sizeof(prof->heat));\n"
+           << "#endif\n"
+           << "    for (int i = 0; i < MEM_MAX_PATTERNS; i++)\n"
+           << "        prof->patterns[i] = MEM_EMPTY_PATTERN;\n"
            << "    memset(prof->pattern_counts, 0, sizeof(prof->pattern_counts));\n"
+           << "    memset(prof->pattern_errors, 0, sizeof(prof->pattern_errors));\n"
+           << "#if MEM_SAMPLE_PERIOD > 1\n"
+           << "    memset(prof->pattern_exact, 0, sizeof(prof->pattern_exact));\n"
+           << "    prof->exact_accesses = 0;\n"
+           << "#endif\n"
+           << "    prof->last_pattern = 0;\n"
+           << "    prof->run_step = MEM_EMPTY_PATTERN;\n"
+           << "    prof->run_len = 0;\n"
+           << "    for (int i = 0; i < MEM_MAX_NESTED; i++)\n"
+           << "        prof->nested_steps[i] = MEM_EMPTY_PATTERN;\n"
+           << "    memset(prof->nested_lens, 0, sizeof(prof->nested_lens));\n"
+           << "    memset(prof->nested_jumps, 0, sizeof(prof->nested_jumps));\n"
+           << "    memset(prof->nested_counts, 0, sizeof(prof->nested_counts));\n"
+           << "#if MEM_RUN_LENGTHS\n"
+           << "    prof->run_hist_step = MEM_EMPTY_PATTERN;\n"
+           << "    prof->runs = 0;\n"
+           << "    prof->run_total = 0;\n"
+           << "    prof->run_max = 0;\n"
+           << "    memset(prof->run_hist, 0, sizeof(prof->run_hist));\n"
+           << "#endif\n"
+           << "#if MEM_DIM_STRIDES\n"
+           << "    prof->dims = 0;\n"
+           << "    prof->dim_accesses = 0;\n"
+           << "    memset(prof->dim_last, 0, sizeof(prof->dim_last));\n"
+           << "    memset(prof->dim_moves, 0, sizeof(prof->dim_moves));\n"
+           << "    memset(prof->dim_steps, 0, sizeof(prof->dim_steps));\n"
+           << "    memset(prof->dim_counts, 0, sizeof(prof->dim_counts));\n"
+           << "#endif\n"
+           << "#if MEM_LOOP_SITES\n"
+           << "    prof->loop_line = 0;\n"
+           << "#endif\n"
+           << "#if MEM_SHARING\n"
+           << "    prof->share_count = 0;\n"
+           << "    prof->share_last = 0;\n"
+           << "    prof->share_threshold = MEM_SHARE_SCALE;\n"
+           << "#endif\n"
+           << "#if MEM_LOAD_STORE\n"
+           << "    memset(prof->kind_accesses, 0, sizeof(prof->kind_accesses));\n"
+           << "    prof->kind_last[MEM_LOAD] = prof->base_addr;\n"
+           << "    prof->kind_last[MEM_STORE] = prof->base_addr;\n"
+           << "    memset(prof->kind_steps, 0, sizeof(prof->kind_steps));\n"
+           << "    memset(prof->kind_counts, 0, sizeof(prof->kind_counts));\n"
+           << "#endif\n"
+           << "#if MEM_TIMING\n"
+           << "    prof->cycles = 0;\n"
+           << "    prof->timed_accesses = 0;\n"
+           << "#endif\n"
+           << "#if MEM_PHASE_WINDOW > 0\n"
+           << "    prof->phase_start = 0;\n"
+           << "    prof->phase_low = ~(size_t)0;\n"
+           << "    prof->phase_high = 0;\n"
+           << "    prof->phase_analyzed = 0;\n"
+           << "    memcpy(prof->phase_steps, prof->patterns, sizeof(prof->patterns));\n"
+           << "    memset(prof->phase_counts, 0, sizeof(prof->phase_counts));\n"
+           << "    prof->phase_count = 0;\n"
+           << "#endif\n"
+           << "#if MEM_BATCH_SIZE > 0\n"
+           << "    prof->batch_len = 0;\n"
+           << "#endif\n"
+           << "}\n\n"
+           << "// 标记分析结果只统计起始于第line行的循环中的访问，在 __mem_init 之后调用\n"
+           << "MEM_API void __mem_loop(mem_profile_t* prof, unsigned line) {\n"
+           << "#if MEM_LOOP_SITES\n"
+           << "    prof->loop_line = line;\n"
+           << "#else\n"
+           << "    (void)prof;\n"
+           << "    (void)line;\n"
+           << "#endif\n"
            << "}\n\n";
         return ss.str();
     }
@@ -94,41 +649,816 @@ public:
     static std::string generateRecordFunction()
     {
         std::stringstream ss;
-        ss << "// 记录一次内存访问\n"
-           << "static inline void __mem_record(mem_profile_t* prof, void* addr) {\n"
-           << "    size_t step;\n"
+        ss << "// 把计数c加n。紧凑布局下将要溢出时先把该分析结果的全部计数减半，之后的访问相对此前\n"
+           << "// 的访问权重加倍；报告按模式计数之和换算百分比，各模式的相对大小不受影响\n"
+           << "static inline void __mem_count_add(mem_profile_t* prof, mem_count_t* c, size_t n) {\n"
+           << "#if MEM_COMPACT\n"
+           << "    int i;\n"
+           << "    if (n > MEM_COUNT_MAX / 2)\n"
+           << "        n = MEM_COUNT_MAX / 2;\n"
+           << "    while (*c > MEM_COUNT_MAX - n) {\n"
+           << "        for (i = 0; i < MEM_MAX_PATTERNS; i++) {\n"
+           << "            prof->pattern_counts[i] >>= 1;\n"
+           << "            prof->pattern_errors[i] >>= 1;\n"
+           << "#if MEM_SAMPLE_PERIOD > 1\n"
+           << "            prof->pattern_exact[i] >>= 1;\n"
+           << "#endif\n"
+           << "        }\n"
+           << "        for (i = 0; i < MEM_MAX_NESTED; i++)\n"
+           << "            prof->nested_counts[i] >>= 1;\n"
+           << "#if MEM_PHASE_WINDOW > 0\n"
+           << "        for (i = 0; i < MEM_MAX_PATTERNS; i++)\n"
+           << "            prof->phase_counts[i] >>= 1;\n"
+           << "#endif\n"
+           << "    }\n"
+           << "#else\n"
+           << "    (void)prof;\n"
+           << "#endif\n"
+           << "    *c += (mem_count_t)n;\n"
+           << "}\n\n"
+           << "// 计数换算为访问次数的比例，slot为模式表位置，为负时换算嵌套模式等其他计数。完整布局的计数\n"
+           << "// 在分析后已是访问次数；紧凑布局的计数可能被减半过且不按采样率还原，按模式计数之和换算，\n"
+           << "// 采样时仿射摘要的精确计数与采样计数分别按各自的访问次数换算\n"
+           << "static inline double __mem_count_scale(const mem_profile_t* prof, int slot) {\n"
+           << "#if MEM_COMPACT\n"
+           << "    size_t sum = 0;\n"
+           << "    for (int i = 0; i < MEM_MAX_PATTERNS; i++)\n"
+           << "        sum += prof->pattern_counts[i];\n"
+           << "#if MEM_SAMPLE_PERIOD > 1\n"
+           << "    if (slot >= 0 && prof->pattern_counts[slot] > 0) {\n"
+           << "        size_t exact = 0;\n"
+           << "        double exact_scale, sampled_scale;\n"
+           << "        for (int i = 0; i < MEM_MAX_PATTERNS; i++)\n"
+           << "            exact += prof->pattern_exact[i];\n"
+           << "        exact_scale = exact > 0 ? (double)prof->exact_accesses / exact : 0.0;\n"
+           << "        sampled_scale = sum > exact ? (double)(prof->total_accesses - prof->exact_accesses) / (sum - exact) : 0.0;\n"
+           << "        return (prof->pattern_exact[slot] * exact_scale +\n"
+           << "                (prof->pattern_counts[slot] - prof->pattern_exact[slot]) * sampled_scale) / prof->pattern_counts[slot];\n"
+           << "    }\n"
+           << "#endif\n"
+           << "    (void)slot;\n"
+           << "    return sum > 0 ? (double)prof->total_accesses / sum : 0.0;\n"
+           << "#else\n"
+           << "    (void)prof;\n"
+           << "    (void)slot;\n"
+           << "    return 1.0;\n"
+           << "#endif\n"
+           << "}\n\n"
+           << "// 将count次步长为step的访问计入访存模式表（Space-Saving）。\n"
+           << "// 命中时只需一次比较或从散列位置开始的少量探测；未命中时替换计数最小的表项\n"
+           << "// （空表项计数为0，会被优先使用），被替换的计数记为新模式的误差上界。\n"
+           << "// 任何出现频率超过 1/MEM_MAX_PATTERNS 的步长都保证留在表中\n"
+           << "static inline void __mem_add_pattern(mem_profile_t* prof, long step, size_t count) {\n"
+           << "    int i, slot, victim;\n"
+           << "    \n"
+           << "    // 快速路径：与上次命中的步长相同\n"
+           << "    slot = prof->last_pattern;\n"
+           << "    if (prof->patterns[slot] == step) {\n"
+           << "        __mem_count_add(prof, &prof->pattern_counts[slot], count);\n"
+           << "        return;\n"
+           << "    }\n"
+           << "    \n"
+           << "    slot = MEM_PATTERN_HASH(step);\n"
+           << "    victim = slot;\n"
+           << "    for (i = 0; i < MEM_MAX_PATTERNS; i++) {\n"
+           << "        if (prof->patterns[slot] == step) {\n"
+           << "            __mem_count_add(prof, &prof->pattern_counts[slot], count);\n"
+           << "            prof->last_pattern = slot;\n"
+           << "            return;\n"
+           << "        }\n"
+           << "        if (prof->pattern_counts[slot] < prof->pattern_counts[victim])\n"
+           << "            victim = slot;\n"
+           << "        slot = slot + 1 == MEM_MAX_PATTERNS ? 0 : slot + 1;\n"
+           << "    }\n"
+           << "    \n"
+           << "    prof->patterns[victim] = (mem_step_t)step;\n"
+           << "    prof->pattern_errors[victim] = prof->pattern_counts[victim];\n"
+           << "#if MEM_SAMPLE_PERIOD > 1\n"
+           << "    prof->pattern_exact[victim] = 0;\n"
+           << "#endif\n"
+           << "    __mem_count_add(prof, &prof->pattern_counts[victim], count);\n"
+           << "    prof->last_pattern = victim;\n"
+           << "}\n\n"
+           << "#if MEM_SAMPLE_PERIOD > 1\n"
+           << "// 把模式表第slot项的n次计数标为精确计数（来自仿射摘要），不超过该项的计数\n"
+           << "static inline void __mem_add_exact(mem_profile_t* prof, int slot, size_t n) {\n"
+           << "    mem_count_t* exact = &prof->pattern_exact[slot];\n"
+           << "    *exact = (size_t)(prof->pattern_counts[slot] - *exact) > n ? (mem_count_t)(*exact + n)\n"
+           << "                                                              : prof->pattern_counts[slot];\n"
+           << "}\n"
+           << "#endif\n\n"
+           << "// 记录一段嵌套模式：连续len次步长为step的访问之后跳转jump个元素。\n"
+           << "// 嵌套模式表同样按Space-Saving替换次数最少的表项，计数为上界估计\n"
+           << "static inline void __mem_add_nested(mem_profile_t* prof, long step, size_t len, long jump) {\n"
+           << "    int i, victim = 0;\n"
+           << "    for (i = 0; i < MEM_MAX_NESTED; i++) {\n"
+           << "        if (prof->nested_steps[i] == step && prof->nested_lens[i] == len && prof->nested_jumps[i] == jump) {\n"
+           << "            __mem_count_add(prof, &prof->nested_counts[i], 1);\n"
+           << "            return;\n"
+           << "        }\n"
+           << "        if (prof->nested_counts[i] < prof->nested_counts[victim])\n"
+           << "            victim = i;\n"
+           << "    }\n"
+           << "    prof->nested_steps[victim] = (mem_step_t)step;\n"
+           << "    prof->nested_lens[victim] = len;\n"
+           << "    prof->nested_jumps[victim] = (mem_step_t)jump;\n"
+           << "    __mem_count_add(prof, &prof->nested_counts[victim], 1);\n"
+           << "}\n\n"
+           << "#if MEM_RUN_LENGTHS\n"
+           << "// 模式表中步长step的计数，不在表中时为0\n"
+           << "static inline size_t __mem_pattern_count(const mem_profile_t* prof, mem_step_t step) {\n"
+           << "    for (int i = 0; i < MEM_MAX_PATTERNS; i++) {\n"
+           << "        if (prof->patterns[i] == step)\n"
+           << "            return prof->pattern_counts[i];\n"
+           << "    }\n"
+           << "    return 0;\n"
+           << "}\n\n"
+           << "// 一段len次步长为step的连续访问结束，共覆盖len+1个元素。直方图只跟踪一个步长：另一个\n"
+           << "// 步长的模式计数超过跟踪步长的1.25倍时改为跟踪它，此前的段数与直方图清零。段结束时\n"
+           << "// 上次命中的模式表项就是该步长，先与已跟踪的元素数比较，多数情况下不必查表\n"
+           << "static inline void __mem_run_end(mem_profile_t* prof, mem_step_t step, size_t len) {\n"
+           << "    int bin = 0;\n"
+           << "    size_t elems = len + 1;\n"
+           << "    if (step != prof->run_hist_step) {\n"
+           << "        size_t count = prof->patterns[prof->last_pattern] == step ? prof->pattern_counts[prof->last_pattern] : 0;\n"
+           << "        if (count <= prof->run_total || count * 4 <= __mem_pattern_count(prof, prof->run_hist_step) * 5)\n"
+           << "            return;\n"
+           << "        prof->run_hist_step = step;\n"
+           << "        prof->runs = 0;\n"
+           << "        prof->run_total = 0;\n"
+           << "        prof->run_max = 0;\n"
+           << "        memset(prof->run_hist, 0, sizeof(prof->run_hist));\n"
+           << "    }\n"
+           << "    while (bin < MEM_RUN_BINS - 1 && (elems >> (bin + 1)) != 0)\n"
+           << "        bin++;\n"
+           << "    prof->run_hist[bin]++;\n"
+           << "    prof->runs++;\n"
+           << "    prof->run_total += elems;\n"
+           << "    prof->run_max = elems > prof->run_max ? elems : prof->run_max;\n"
+           << "}\n"
+           << "#endif\n\n"
+           << "// 结束当前的连续段，分析和合并之前调用，此后的访问开始新的一段\n"
+           << "static inline void __mem_run_close(mem_profile_t* prof) {\n"
+           << "#if MEM_RUN_LENGTHS && MEM_SAMPLE_PERIOD == 1\n"
+           << "    if (prof->run_step != MEM_EMPTY_PATTERN && prof->run_len > 0)\n"
+           << "        __mem_run_end(prof, prof->run_step, prof->run_len);\n"
+           << "    prof->run_len = 0;\n"
+           << "#else\n"
+           << "    (void)prof;\n"
+           << "#endif\n"
+           << "}\n\n"
+           << "// 将count次步长为step的访问计入模式表，同时跟踪连续相同步长的长度：\n"
+           << "// 步长改变时，长度不小于2的一段连续访问连同打断它的跳转记为一次嵌套模式。\n"
+           << "// 采样会丢失段内的跳转，采样模式下不做嵌套模式检测\n"
+           << "static inline void __mem_add_step(mem_profile_t* prof, long step, size_t count) {\n"
+           << "#if MEM_COMPACT\n"
+           << "    // 超出32位的步长饱和处理\n"
+           << "    if (step > MEM_STEP_MAX)\n"
+           << "        step = MEM_STEP_MAX;\n"
+           << "    if (step < -MEM_STEP_MAX)\n"
+           << "        step = -MEM_STEP_MAX;\n"
+           << "#endif\n"
+           << "#if MEM_SAMPLE_PERIOD == 1\n"
+           << "    if (step == prof->run_step) {\n"
+           << "        prof->run_len += count;\n"
+           << "    } else {\n"
+           << "        if (prof->run_len >= 2)\n"
+           << "            __mem_add_nested(prof, prof->run_step, prof->run_len, step);\n"
+           << "#if MEM_RUN_LENGTHS\n"
+           << "        if (prof->run_len > 0)\n"
+           << "            __mem_run_end(prof, prof->run_step, prof->run_len);\n"
+           << "#endif\n"
+           << "        prof->run_step = (mem_step_t)step;\n"
+           << "        prof->run_len = count;\n"
+           << "    }\n"
+           << "#endif\n"
+           << "    __mem_add_pattern(prof, step, count);\n"
+           << "}\n\n"
+           << "#if MEM_REUSE_DISTANCE\n"
+           << "// 缓存行在散列索引中的起始探测位置，取与采样散列值不重叠的乘积位\n"
+           << "static inline int __mem_reuse_home(size_t line) {\n"
+           << "    return (int)((unsigned)(((unsigned long long)line * 0x9E3779B97F4A7C15ULL) >> 8) % MEM_REUSE_INDEX);\n"
+           << "}\n\n"
+           << "// 在散列索引中查找第line行，返回索引位置，未找到时返回-1\n"
+           << "static inline int __mem_reuse_find(mem_profile_t* prof, size_t line) {\n"
+           << "    int i = __mem_reuse_home(line);\n"
+           << "    while (prof->reuse_index[i] != 0) {\n"
+           << "        if (prof->reuse_lines[prof->reuse_index[i] - 1] == line) return i;\n"
+           << "        i = (i + 1) % MEM_REUSE_INDEX;\n"
+           << "    }\n"
+           << "    return -1;\n"
+           << "}\n\n"
+           << "// 删除索引位置i上的表项，后续探测链上的表项前移填补空位（线性探测的后移删除）\n"
+           << "static inline void __mem_reuse_unindex(mem_profile_t* prof, int i) {\n"
+           << "    int j = i, home;\n"
+           << "    for (;;) {\n"
+           << "        j = (j + 1) % MEM_REUSE_INDEX;\n"
+           << "        if (prof->reuse_index[j] == 0) break;\n"
+           << "        home = __mem_reuse_home(prof->reuse_lines[prof->reuse_index[j] - 1]);\n"
+           << "        if (i <= j ? (i < home && home <= j) : (i < home || home <= j)) continue;\n"
+           << "        prof->reuse_index[i] = prof->reuse_index[j];\n"
+           << "        i = j;\n"
+           << "    }\n"
+           << "    prof->reuse_index[i] = 0;\n"
+           << "}\n\n"
+           << "static inline void __mem_reuse_tree_add(mem_profile_t* prof, size_t t, int delta) {\n"
+           << "    for (; t <= MEM_REUSE_WINDOW; t += t & (0 - t))\n"
+           << "        prof->reuse_tree[t] = (unsigned short)(prof->reuse_tree[t] + delta);\n"
+           << "}\n\n"
+           << "// 最近一次访问时刻不晚于t的被跟踪行数\n"
+           << "static inline int __mem_reuse_tree_sum(mem_profile_t* prof, size_t t) {\n"
+           << "    int sum = 0;\n"
+           << "    for (; t > 0; t -= t & (0 - t))\n"
+           << "        sum += prof->reuse_tree[t];\n"
+           << "    return sum;\n"
+           << "}\n\n"
+           << "// 把表项slot的最近访问时刻设为t，t为0时只移除原时刻\n"
+           << "static inline void __mem_reuse_touch(mem_profile_t* prof, int slot, size_t t) {\n"
+           << "    size_t last = prof->reuse_times[slot];\n"
+           << "    if (last != 0) {\n"
+           << "        prof->reuse_owner[last] = 0;\n"
+           << "        __mem_reuse_tree_add(prof, last, -1);\n"
+           << "    }\n"
+           << "    prof->reuse_times[slot] = (unsigned short)t;\n"
+           << "    if (t != 0) {\n"
+           << "        prof->reuse_owner[t] = (unsigned short)(slot + 1);\n"
+           << "        __mem_reuse_tree_add(prof, t, 1);\n"
+           << "    }\n"
+           << "}\n\n"
+           << "// 时刻窗口用完时按先后顺序把各行的时刻重新编号为1..reuse_count并重建树状数组。\n"
+           << "// 每次重编号之后至少还有MEM_REUSE_WINDOW-MEM_REUSE_LINES次访问才会再次用完，均摊为O(1)\n"
+           << "static inline void __mem_reuse_renumber(mem_profile_t* prof) {\n"
+           << "    size_t t, k = 0;\n"
+           << "    memset(prof->reuse_tree, 0, sizeof(prof->reuse_tree));\n"
+           << "    for (t = 1; t <= MEM_REUSE_WINDOW; t++) {\n"
+           << "        int slot = prof->reuse_owner[t];\n"
+           << "        if (slot == 0) continue;\n"
+           << "        prof->reuse_owner[t] = 0;\n"
+           << "        prof->reuse_owner[++k] = (unsigned short)slot;\n"
+           << "        prof->reuse_times[slot - 1] = (unsigned short)k;\n"
+           << "        __mem_reuse_tree_add(prof, k, 1);\n"
+           << "    }\n"
+           << "    prof->reuse_clock = k;\n"
+           << "}\n\n"
+           << "// 以缓存行为粒度统计重用距离（两次访问同一缓存行之间访问过的不同缓存行数）。\n"
+           << "// 按缓存行地址散列做空间采样，最多跟踪MEM_REUSE_LINES行；表满时淘汰散列值最大的行并\n"
+           << "// 降低采样阈值（固定容量的SHARDS），距离和计数都按采样率还原。行的查找走散列索引，\n"
+           << "// 距离由按访问时刻建立的树状数组求出，每次访问为O(log MEM_REUSE_LINES)；只有表满后\n"
+           << "// 登记新行时才线性查找淘汰对象，阈值逐次降低，这种情况随访问的不同行数增长只按对数出现\n"
+           << "static inline void __mem_reuse(mem_profile_t* prof, size_t addr) {\n"
+           << "    size_t line = addr / MEM_LINE_SIZE;\n"
+           << "    unsigned hash = (unsigned)(((unsigned long long)line * 0x9E3779B97F4A7C15ULL) >> 40);\n"
+           << "    size_t weight, dist;\n"
+           << "    int i, pos, found, bin = 0;\n"
+           << "    if (hash >= prof->reuse_threshold) return;\n"
+           << "    \n"
+           << "    weight = MEM_REUSE_SCALE / prof->reuse_threshold;\n"
+           << "    if (prof->reuse_clock == MEM_REUSE_WINDOW)\n"
+           << "        __mem_reuse_renumber(prof);\n"
+           << "    prof->reuse_clock++;\n"
+           << "    pos = __mem_reuse_find(prof, line);\n"
+           << "    \n"
+           << "    if (pos >= 0) {\n"
+           << "        found = prof->reuse_index[pos] - 1;\n"
+           << "        dist = (size_t)(prof->reuse_count - __mem_reuse_tree_sum(prof, prof->reuse_times[found]));\n"
+           << "        dist *= weight;\n"
+           << "        while (bin < MEM_REUSE_BINS - 1 && (dist >> bin) != 0)\n"
+           << "            bin++;\n"
+           << "        prof->reuse_hist[bin] += weight;\n"
+           << "        __mem_reuse_touch(prof, found, prof->reuse_clock);\n"
+           << "        return;\n"
+           << "    }\n"
+           << "    \n"
+           << "    // 首次访问该缓存行\n"
+           << "    prof->reuse_hist[MEM_REUSE_BINS] += weight;\n"
+           << "    if (prof->reuse_count < MEM_REUSE_LINES) {\n"
+           << "        found = prof->reuse_count++;\n"
+           << "        prof->reuse_times[found] = 0;\n"
+           << "    } else {\n"
+           << "        found = 0;\n"
+           << "        for (i = 1; i < MEM_REUSE_LINES; i++) {\n"
+           << "            if (prof->reuse_hashes[i] > prof->reuse_hashes[found])\n"
+           << "                found = i;\n"
+           << "        }\n"
+           << "        if (hash > prof->reuse_hashes[found]) {\n"
+           << "            prof->reuse_threshold = hash;\n"
+           << "            return;\n"
+           << "        }\n"
+           << "        prof->reuse_threshold = prof->reuse_hashes[found];\n"
+           << "        __mem_reuse_unindex(prof, __mem_reuse_find(prof, prof->reuse_lines[found]));\n"
+           << "    }\n"
+           << "    prof->reuse_lines[found] = line;\n"
+           << "    prof->reuse_hashes[found] = hash;\n"
+           << "    __mem_reuse_touch(prof, found, prof->reuse_clock);\n"
+           << "    for (pos = __mem_reuse_home(line); prof->reuse_index[pos] != 0; pos = (pos + 1) % MEM_REUSE_INDEX) {}\n"
+           << "    prof->reuse_index[pos] = (unsigned short)(found + 1);\n"
+           << "}\n"
+           << "#endif\n"
+           << "\n"
+           << "#if MEM_SHARING\n"
+           << "// 查找或登记第line行，返回表项下标，该行未被采样时返回-1。与重用距离一样按行地址散列做\n"
+           << "// 空间采样，表满时淘汰散列值最大的行并降低阈值；各线程采样的是同一批行，合并时可以逐行比较\n"
+           << "static inline int __mem_share_slot(mem_profile_t* prof, size_t line) {\n"
+           << "    unsigned hash;\n"
+           << "    int i, found;\n"
+           << "    if (prof->share_last < prof->share_count && prof->share_lines[prof->share_last] == line)\n"
+           << "        return prof->share_last;\n"
+           << "    hash = (unsigned)(((unsigned long long)line * 0x9E3779B97F4A7C15ULL) >> 40);\n"
+           << "    if (hash >= prof->share_threshold) return -1;\n"
+           << "    for (i = 0; i < prof->share_count; i++) {\n"
+           << "        if (prof->share_lines[i] == line)\n"
+           << "            return prof->share_last = i;\n"
+           << "    }\n"
+           << "    \n"
+           << "    if (prof->share_count < MEM_SHARE_LINES) {\n"
+           << "        found = prof->share_count++;\n"
+           << "    } else {\n"
+           << "        found = 0;\n"
+           << "        for (i = 1; i < MEM_SHARE_LINES; i++) {\n"
+           << "            if (prof->share_hashes[i] > prof->share_hashes[found])\n"
+           << "                found = i;\n"
+           << "        }\n"
+           << "        if (hash > prof->share_hashes[found]) {\n"
+           << "            prof->share_threshold = hash;\n"
+           << "            return -1;\n"
+           << "        }\n"
+           << "        prof->share_threshold = prof->share_hashes[found];\n"
+           << "    }\n"
+           << "    prof->share_lines[found] = line;\n"
+           << "    prof->share_hashes[found] = hash;\n"
+           << "    prof->share_reads[found] = 0;\n"
+           << "    prof->share_writes[found] = 0;\n"
+           << "    prof->share_flags[found] = 0;\n"
+           << "    return prof->share_last = found;\n"
+           << "}\n\n"
+           << "// 把行内从offset开始的size个字节计入读或写的字节掩码，超出行尾的部分不计\n"
+           << "static inline void __mem_share_mark(mem_profile_t* prof, int slot, size_t offset, size_t size, int kind) {\n"
+           << "    size_t end = offset + size < MEM_SHARE_LINE ? offset + size : MEM_SHARE_LINE;\n"
+           << "    size_t first = offset / MEM_SHARE_GRAIN, bits = (end - 1) / MEM_SHARE_GRAIN - first + 1;\n"
+           << "    unsigned long long mask = (bits >= 64 ? ~0ULL : (1ULL << bits) - 1) << first;\n"
+           << "    if (kind != MEM_STORE)\n"
+           << "        prof->share_reads[slot] |= mask;\n"
+           << "    if (kind != MEM_LOAD)\n"
+           << "        prof->share_writes[slot] |= mask;\n"
+           << "}\n\n"
+           << "// 记录一次访问触及的行与字节，不受时间采样影响\n"
+           << "static inline void __mem_share(mem_profile_t* prof, size_t addr, int kind) {\n"
+           << "    int slot = __mem_share_slot(prof, addr / MEM_SHARE_LINE);\n"
+           << "    if (slot >= 0)\n"
+           << "        __mem_share_mark(prof, slot, addr % MEM_SHARE_LINE, prof->type_size, kind);\n"
+           << "}\n\n"
+           << "// 记录从low开始、间隔stride字节的count次访问。间隔不小于一行时逐个访问记录；否则逐行检查\n"
+           << "// 是否被采样，只在被采样的行中标记落入该行的元素，开销与访问次数成正比\n"
+           << "static inline void __mem_share_range(mem_profile_t* prof, size_t low, size_t stride, size_t count, int kind) {\n"
+           << "    size_t line, start, k, addr, last = low + (count - 1) * stride;\n"
+           << "    int slot;\n"
+           << "    if (stride == 0 || stride >= MEM_SHARE_LINE) {\n"
+           << "        for (k = 0; k < (stride == 0 ? 1 : count); k++)\n"
+           << "            __mem_share(prof, low + k * stride, kind);\n"
+           << "        return;\n"
+           << "    }\n"
+           << "    for (line = low / MEM_SHARE_LINE; line <= last / MEM_SHARE_LINE; line++) {\n"
+           << "        slot = __mem_share_slot(prof, line);\n"
+           << "        if (slot < 0) continue;\n"
+           << "        start = line * MEM_SHARE_LINE;\n"
+           << "        k = start > low ? (start - low + stride - 1) / stride : 0;\n"
+           << "        for (addr = low + k * stride; k < count && addr < start + MEM_SHARE_LINE; k++, addr += stride)\n"
+           << "            __mem_share_mark(prof, slot, addr - start, prof->type_size, kind);\n"
+           << "    }\n"
+           << "}\n\n"
+           << "// 按类别统计被标记的行数，按采样率还原\n"
+           << "static inline void __mem_share_counts(mem_profile_t* prof, size_t counts[3]) {\n"
+           << "    size_t weight = MEM_SHARE_SCALE / prof->share_threshold;\n"
+           << "    int i, k;\n"
+           << "    counts[0] = counts[1] = counts[2] = 0;\n"
+           << "    for (i = 0; i < prof->share_count; i++) {\n"
+           << "        for (k = 0; k < 3; k++)\n"
+           << "            counts[k] += (prof->share_flags[i] >> k & 1) * weight;\n"
+           << "    }\n"
+           << "}\n\n"
+           << "// 行号不小于from的伪共享行中行号最小的表项，没有时返回-1，用于按地址顺序列出伪共享行\n"
+           << "static inline int __mem_false_line(mem_profile_t* prof, size_t from) {\n"
+           << "    int i, best = -1;\n"
+           << "    for (i = 0; i < prof->share_count; i++) {\n"
+           << "        if (!(prof->share_flags[i] & MEM_FALSE_SHARING) || prof->share_lines[i] < from) continue;\n"
+           << "        if (best < 0 || prof->share_lines[i] < prof->share_lines[best])\n"
+           << "            best = i;\n"
+           << "    }\n"
+           << "    return best;\n"
+           << "}\n"
+           << "#endif\n"
+           << "\n"
+           << "#if MEM_HEAT_MAP\n"
+           << "// 扩展热度直方图，使其覆盖[low, high]和已有计数，且桶宽不小于2^shift。桶宽逐次加倍直到\n"
+           << "// 范围足够；起始地址按新桶宽对齐，原有的每个桶都整体落入一个新桶，计数保持精确\n"
+           << "static inline void __mem_heat_cover(mem_profile_t* prof, size_t low, size_t high, unsigned shift) {\n"
+           << "    size_t old[MEM_HEAT_BINS];\n"
+           << "    size_t old_base = prof->heat_base;\n"
+           << "    unsigned old_shift = prof->heat_shift;\n"
+           << "    int i, first = -1, last = -1;\n"
+           << "    for (i = 0; i < MEM_HEAT_BINS; i++) {\n"
+           << "        if (prof->heat[i] == 0) continue;\n"
+           << "        if (first < 0) first = i;\n"
+           << "        last = i;\n"
+           << "    }\n"
+           << "    if (first >= 0) {\n"
+           << "        size_t a = old_base + ((size_t)first << old_shift);\n"
+           << "        size_t b = old_base + ((size_t)(last + 1) << old_shift) - 1;\n"
+           << "        low = a < low ? a : low;\n"
+           << "        high = b > high ? b : high;\n"
+           << "    }\n"
+           << "    shift = shift > old_shift ? shift : old_shift;\n"
+           << "    while (shift < 63 && (high >> shift) - (low >> shift) >= MEM_HEAT_BINS)\n"
+           << "        shift++;\n"
+           << "    \n"
+           << "    memcpy(old, prof->heat, sizeof(old));\n"
+           << "    memset(prof->heat, 0, sizeof(prof->heat));\n"
+           << "    prof->heat_base = low >> shift << shift;\n"
+           << "    prof->heat_shift = shift;\n"
+           << "    for (i = first; i >= 0 && i <= last; i++)\n"
+           << "        prof->heat[(old_base + ((size_t)i << old_shift) - prof->heat_base) >> shift] += old[i];\n"
+           << "}\n\n"
+           << "// 把n次落在addr的访问计入热度直方图，地址超出当前范围时先扩展\n"
+           << "static inline void __mem_heat(mem_profile_t* prof, size_t addr, size_t n) {\n"
+           << "    size_t bin = (addr - prof->heat_base) >> prof->heat_shift;\n"
+           << "    if (bin >= MEM_HEAT_BINS) {\n"
+           << "        __mem_heat_cover(prof, addr, addr, 0);\n"
+           << "        bin = (addr - prof->heat_base) >> prof->heat_shift;\n"
+           << "    }\n"
+           << "    prof->heat[bin] += n;\n"
+           << "}\n\n"
+           << "// 把从low开始、间隔bytes字节的count次访问计入热度直方图，每个桶只做一次除法\n"
+           << "static inline void __mem_heat_range(mem_profile_t* prof, size_t low, size_t bytes, size_t count) {\n"
+           << "    size_t high = low + (count - 1) * bytes;\n"
+           << "    size_t bin, end, k0, k1;\n"
+           << "    if (bytes == 0) {\n"
+           << "        __mem_heat(prof, low, count);\n"
+           << "        return;\n"
+           << "    }\n"
+           << "    if (((low - prof->heat_base) >> prof->heat_shift) >= MEM_HEAT_BINS ||\n"
+           << "        ((high - prof->heat_base) >> prof->heat_shift) >= MEM_HEAT_BINS)\n"
+           << "        __mem_heat_cover(prof, low, high, 0);\n"
+           << "    \n"
+           << "    // 第k次访问的地址为low + k * bytes，落在当前桶内的是第[k0, k1)次\n"
+           << "    bin = (low - prof->heat_base) >> prof->heat_shift;\n"
+           << "    for (k0 = 0; k0 < count; bin++) {\n"
+           << "        end = prof->heat_base + ((bin + 1) << prof->heat_shift);\n"
+           << "        k1 = (end - low + bytes - 1) / bytes;\n"
+           << "        k1 = k1 < count ? k1 : count;\n"
+           << "        prof->heat[bin] += k1 - k0;\n"
+           << "        k0 = k1;\n"
+           << "    }\n"
+           << "}\n"
+           << "#endif\n"
+           << "\n"
+           << "#if MEM_BATCH_SIZE > 0\n"
+           << "// 批量处理缓冲区中的访问地址。地址范围与步长的计算在各元素间互不依赖，\n"
+           << "// 便于编译器向量化；随后把连续相同的步长合并为一次模式表更新\n"
+           << "static inline void __mem_flush(mem_profile_t* prof) {\n"
+           << "    long steps[MEM_BATCH_SIZE];\n"
+           << "    size_t n = prof->batch_len;\n"
+           << "    size_t low = prof->base_addr;\n"
+           << "    size_t high = prof->end_addr;\n"
+           << "    size_t i, run;\n"
+           << "    if (n == 0) return;\n"
+           << "    \n"
+           << "    for (i = 0; i < n; i++) {\n"
+           << "        size_t a = prof->batch[i];\n"
+           << "        low = a < low ? a : low;\n"
+           << "        high = a > high ? a : high;\n"
+           << "    }\n"
+           << "    steps[0] = (long)(prof->batch[0] - prof->last_addr);\n"
+           << "    for (i = 1; i < n; i++) {\n"
+           << "        size_t a = prof->batch[i];\n"
+           << "        size_t b = prof->batch[i - 1];\n"
+           << "        steps[i] = (long)(a - b);\n"
+           << "    }\n"
+           << "    prof->base_addr = low;\n"
+           << "    prof->end_addr = high;\n"
+           << "    prof->last_addr = prof->batch[n - 1];\n"
+           << "    prof->batch_len = 0;\n"
+           << "    \n"
+           << "    // 步长以字节为单位合并，每段只做一次除法\n"
+           << "    run = 1;\n"
+           << "    for (i = 1; i <= n; i++) {\n"
+           << "        if (i < n && steps[i] == steps[i - 1]) {\n"
+           << "            run++;\n"
+           << "            continue;\n"
+           << "        }\n"
+           << "        __mem_add_step(prof, steps[i - 1] / (long)prof->type_size, run);\n"
+           << "        run = 1;\n"
+           << "    }\n"
+           << "}\n"
+           << "#endif\n"
+           << "\n"
+           << "#if MEM_PHASE_WINDOW > 0\n"
+           << "// 阶段的类别：主要步长占一半以上访问时为该步长，否则为不规则访问\n"
+           << "static inline mem_step_t __mem_phase_key(const mem_phase_t* phase) {\n"
+           << "    return (size_t)phase->counts[0] * 2 >= phase->analyzed ? phase->steps[0] : MEM_EMPTY_PATTERN;\n"
+           << "}\n\n"
+           << "// 在第end次访问处结束当前窗口。模式表不清空：与窗口开始时的快照相减得到窗口内各步长的\n"
+           << "// 次数（窗口内被替换进来的表项取计数减去误差），保留最频繁的MEM_PHASE_TOP个。占比的分母是\n"
+           << "// 窗口内实际分析的步长数而不是各表项差值之和：不规则访问时表项频繁替换，差值之和远小于\n"
+           << "// 分析的步长数。类别与上一阶段相同的窗口并入上一阶段，否则开始新阶段；环形表只保留最近\n"
+           << "// MEM_MAX_PHASES个阶段\n"
+           << "static inline void __mem_phase_close(mem_profile_t* prof, size_t end) {\n"
+           << "    mem_phase_t cur;\n"
+           << "    mem_phase_t* last;\n"
+           << "    size_t delta;\n"
+           << "    int i, j, k;\n"
+           << "#if MEM_BATCH_SIZE > 0\n"
+           << "    __mem_flush(prof);\n"
+           << "#endif\n"
+           << "    if (end <= prof->phase_start) return;\n"
+           << "    \n"
+           << "    memset(&cur, 0, sizeof(cur));\n"
+           << "    for (k = 0; k < MEM_PHASE_TOP; k++)\n"
+           << "        cur.steps[k] = MEM_EMPTY_PATTERN;\n"
+           << "    cur.start = prof->phase_start;\n"
+           << "    cur.accesses = end - prof->phase_start;\n"
+           << "    cur.low = prof->phase_low;\n"
+           << "    cur.high = prof->phase_high;\n"
+           << "    cur.analyzed = prof->phase_analyzed;\n"
+           << "    for (i = 0; i < MEM_MAX_PATTERNS; i++) {\n"
+           << "        if (prof->patterns[i] == MEM_EMPTY_PATTERN) continue;\n"
+           << "        delta = prof->patterns[i] == prof->phase_steps[i] ? prof->pattern_counts[i] - prof->phase_counts[i]\n"
+           << "                                                          : prof->pattern_counts[i] - prof->pattern_errors[i];\n"
+
+           << "        for (k = MEM_PHASE_TOP; k > 0 && delta > cur.counts[k - 1]; k--) {}\n"
+           << "        if (k == MEM_PHASE_TOP) continue;\n"
+           << "        for (j = MEM_PHASE_TOP - 1; j > k; j--) {\n"
+           << "            cur.steps[j] = cur.steps[j - 1];\n"
+           << "            cur.counts[j] = cur.counts[j - 1];\n"
+           << "        }\n"
+           << "        cur.steps[k] = prof->patterns[i];\n"
+           << "        cur.counts[k] = (mem_count_t)delta;\n"
+           << "    }\n"
+           << "    memcpy(prof->phase_steps, prof->patterns, sizeof(prof->patterns));\n"
+           << "    memcpy(prof->phase_counts, prof->pattern_counts, sizeof(prof->pattern_counts));\n"
+           << "    prof->phase_start = end;\n"
+           << "    prof->phase_low = ~(size_t)0;\n"
+           << "    prof->phase_high = 0;\n"
+           << "    prof->phase_analyzed = 0;\n"
+           << "    \n"
+           << "    last = prof->phase_count > 0 ? &prof->phases[(prof->phase_count - 1) % MEM_MAX_PHASES] : 0;\n"
+           << "    if (last && __mem_phase_key(last) == __mem_phase_key(&cur)) {\n"
+           << "        last->accesses += cur.accesses;\n"
+           << "        last->analyzed += cur.analyzed;\n"
+           << "        last->low = cur.low < last->low ? cur.low : last->low;\n"
+           << "        last->high = cur.high > last->high ? cur.high : last->high;\n"
+           << "        for (k = 0; k < MEM_PHASE_TOP; k++) {\n"
+           << "            for (j = 0; j < MEM_PHASE_TOP; j++) {\n"
+           << "                if (last->steps[j] == cur.steps[k] && cur.steps[k] != MEM_EMPTY_PATTERN)\n"
+           << "                    last->counts[j] += cur.counts[k];\n"
+           << "            }\n"
+           << "        }\n"
+           << "        return;\n"
+           << "    }\n"
+           << "    prof->phases[prof->phase_count % MEM_MAX_PHASES] = cur;\n"
+           << "    prof->phase_count++;\n"
+           << "}\n\n"
+           << "// 前before次访问已满一个窗口时结束窗口，随后把[low, high]和analyzed个被分析的步长计入当前窗口\n"
+           << "static inline void __mem_phase_step(mem_profile_t* prof, size_t low, size_t high, size_t before,\n"
+           << "                                    size_t analyzed) {\n"
+           << "    if (before - prof->phase_start >= MEM_PHASE_WINDOW)\n"
+           << "        __mem_phase_close(prof, before);\n"
+           << "    prof->phase_analyzed += analyzed;\n"
+           << "    prof->phase_low = low < prof->phase_low ? low : prof->phase_low;\n"
+           << "    prof->phase_high = high > prof->phase_high ? high : prof->phase_high;\n"
+           << "}\n"
+           << "#endif\n"
+           << "\n"
+           << "#if MEM_LOAD_STORE\n"
+           << "// 把count次步长为step的读或写计入该类别的步长表，表满时替换计数最小的表项\n"
+           << "static inline void __mem_kind_step(mem_profile_t* prof, int kind, long step, size_t count) {\n"
+           << "    int i, victim = 0;\n"
+           << "    for (i = 0; i < MEM_KIND_PATTERNS; i++) {\n"
+           << "        if (prof->kind_steps[kind][i] == step) break;\n"
+           << "        if (prof->kind_counts[kind][i] < prof->kind_counts[kind][victim])\n"
+           << "            victim = i;\n"
+           << "    }\n"
+           << "    if (i == MEM_KIND_PATTERNS) {\n"
+           << "        i = victim;\n"
+           << "        prof->kind_steps[kind][i] = step;\n"
+           << "        prof->kind_counts[kind][i] = 0;\n"
+           << "    }\n"
+           << "    prof->kind_counts[kind][i] += count;\n"
+           << "}\n\n"
+           << "// 读和写各自形成一条访问序列：从addr开始共count次、间隔stride个元素的访问。\n"
+           << "// 不受采样影响，次数是精确值\n"
+           << "static inline void __mem_kind(mem_profile_t* prof, int kind, size_t addr, long stride, size_t count) {\n"
+           << "    __mem_kind_step(prof, kind, (long)(addr - prof->kind_last[kind]) / (long)prof->type_size, 1);\n"
+           << "    if (count > 1)\n"
+           << "        __mem_kind_step(prof, kind, stride, count - 1);\n"
+           << "    prof->kind_last[kind] = addr + (size_t)((long)(count - 1) * stride * (long)prof->type_size);\n"
+           << "    prof->kind_accesses[kind] += count;\n"
+           << "}\n"
+           << "#endif\n"
+           << "\n"
+           << "// 记录一次内存访问\n"
+
+           << "MEM_API void __mem_record(mem_profile_t* prof, void* addr) {\n"
+           << "    long step;\n"
            << "    size_t curr_addr = (size_t)addr;\n"
            << "    \n"
+           << "#if MEM_SAMPLE_PERIOD > 1\n"
+           << "    // 采样：每个周期只分析前MEM_SAMPLE_BURST次访问，\n"
+           << "    // 周期最后一次访问仅更新last_addr，避免下一段首个步长被周期放大\n"
+           << "    unsigned phase = prof->sample_phase;\n"
+           << "    prof->total_accesses++;\n"
+           << "    prof->sample_phase = phase + 1 == MEM_SAMPLE_PERIOD ? 0 : phase + 1;\n"
+           << "    if (phase >= MEM_SAMPLE_BURST) {\n"
+           << "        if (phase == MEM_SAMPLE_PERIOD - 1) {\n"
+           << "#if MEM_BATCH_SIZE > 0\n"
+           << "            // 缓冲区中的步长只在同一段突发内连续，段与段之间先处理掉\n"
+           << "            __mem_flush(prof);\n"
+           << "#endif\n"
+           << "            prof->last_addr = curr_addr;\n"
+           << "        }\n"
+           << "        return;\n"
+           << "    }\n"
+           << "    if (prof->sampled_accesses++ == 0 && prof->exact_accesses == 0) {\n"
+           << "#else\n"
            << "    // 如果是第一次访问，更新last_addr为第一次访存地址\n"
-           << "    if (prof->total_accesses == 0) {\n"
+           << "    if (prof->total_accesses++ == 0) {\n"
+           << "#endif\n"
            << "        prof->last_addr = curr_addr;\n"
            << "        prof->base_addr = curr_addr;\n"
            << "        prof->end_addr = curr_addr;\n"
            << "    }\n"
-           << "    prof->total_accesses++;\n"
+           << "    \n"
+           << "#if MEM_REUSE_DISTANCE\n"
+           << "    __mem_reuse(prof, curr_addr);\n"
+           << "#endif\n"
+           << "#if MEM_HEAT_MAP\n"
+           << "    __mem_heat(prof, curr_addr, 1);\n"
+           << "#endif\n"
+           << "#if MEM_PHASE_WINDOW > 0\n"
+           << "    __mem_phase_step(prof, curr_addr, curr_addr, prof->total_accesses - 1, 1);\n"
+           << "#endif\n"
+           << "#if MEM_BATCH_SIZE > 0\n"
+           << "    // 批量模式只追加地址，缓冲区满时统一处理\n"
+           << "    prof->batch[prof->batch_len++] = curr_addr;\n"
+           << "    if (prof->batch_len == MEM_BATCH_SIZE)\n"
+           << "        __mem_flush(prof);\n"
+           << "    return;\n"
+           << "#endif\n"
            << "    \n"
            << "    // 计算归一化访存步长\n"
-           << "    step = curr_addr < prof->last_addr ? (prof->last_addr - curr_addr) : (curr_addr - "
-              "prof->last_addr);\n"
-           << "    step /= prof->type_size;\n"
+           << "    step = (long)(curr_addr - prof->last_addr) / (long)prof->type_size;\n"
            << "    prof->last_addr = curr_addr;\n"
            << "    prof->end_addr = curr_addr > prof->end_addr ? curr_addr : prof->end_addr;\n"
            << "    prof->base_addr = curr_addr < prof->base_addr ? curr_addr : prof->base_addr;\n"
            << "    \n"
-           << "    // 判断跨步过大的访问\n"
-           << "    if (step >= 65536) return;\n"
-           << "    \n"
            << "    // 记录访存模式\n"
-           << "    for(int i = 0; i < MEM_MAX_PATTERNS; i++) {\n"
-           << "        if(prof->patterns[i] == step) {\n"
-           << "            prof->pattern_counts[i]++;\n"
-           << "            return;\n"
-           << "        }else if(prof->patterns[i] == 0xFFFFFFFFFFFFFFFF) {\n"
-           << "            prof->patterns[i] = step;\n"
-           << "            prof->pattern_counts[i] = 1;\n"
-           << "            return;\n"
+           << "    __mem_add_step(prof, step, 1);\n"
+           << "}\n\n"
+           << "// 记录一段仿射循环访问的摘要：从first开始共count次访问，相邻两次间隔stride个元素。\n"
+           << "// 摘要是精确值，采样模式下单独计数，分析时不按采样率放大\n"
+           << "MEM_API void __mem_record_affine(mem_profile_t* prof, void* first, long stride, long count) {\n"
+           << "    size_t first_addr = (size_t)first;\n"
+           << "    size_t last_addr;\n"
+           << "    size_t low, high;\n"
+           << "    if (count <= 0) return;\n"
+           << "#if MEM_BATCH_SIZE > 0\n"
+           << "    __mem_flush(prof);\n"
+           << "#endif\n"
+           << "    \n"
+           << "    last_addr = first_addr + (size_t)((count - 1) * stride * (long)prof->type_size);\n"
+           << "    low = stride < 0 ? last_addr : first_addr;\n"
+           << "    high = stride < 0 ? first_addr : last_addr;\n"
+           << "    \n"
+           << "#if MEM_SAMPLE_PERIOD > 1\n"
+           << "    prof->total_accesses += count;\n"
+           << "    if (prof->sampled_accesses == 0 && prof->exact_accesses == 0) {\n"
+           << "#else\n"
+           << "    if (prof->total_accesses == 0) {\n"
+           << "#endif\n"
+           << "        prof->last_addr = first_addr;\n"
+           << "        prof->base_addr = low;\n"
+           << "        prof->end_addr = high;\n"
+           << "    }\n"
+           << "#if MEM_SAMPLE_PERIOD > 1\n"
+           << "    prof->exact_accesses += count;\n"
+           << "#else\n"
+           << "    prof->total_accesses += count;\n"
+           << "#endif\n"
+           << "#if MEM_HEAT_MAP\n"
+           << "    __mem_heat_range(prof, low, (size_t)(stride < 0 ? -stride : stride) * prof->type_size, (size_t)count);\n"
+           << "#endif\n"
+           << "#if MEM_PHASE_WINDOW > 0\n"
+           << "    __mem_phase_step(prof, low, high, prof->total_accesses - (size_t)count, (size_t)count);\n"
+           << "#endif\n"
+           << "    \n"
+           << "    // 进入循环前的一次跳转，加上循环内count-1次等距访问\n"
+           << "    __mem_add_step(prof, (long)(first_addr - prof->last_addr) / (long)prof->type_size, 1);\n"
+           << "#if MEM_SAMPLE_PERIOD > 1\n"
+           << "    __mem_add_exact(prof, prof->last_pattern, 1);\n"
+           << "#endif\n"
+           << "    if (count > 1) {\n"
+           << "        __mem_add_step(prof, stride, (size_t)(count - 1));\n"
+           << "#if MEM_SAMPLE_PERIOD > 1\n"
+           << "        __mem_add_exact(prof, prof->last_pattern, (size_t)(count - 1));\n"
+           << "#endif\n"
+           << "    }\n"
+           << "    \n"
+           << "    prof->last_addr = last_addr;\n"
+           << "    prof->end_addr = high > prof->end_addr ? high : prof->end_addr;\n"
+           << "    prof->base_addr = low < prof->base_addr ? low : prof->base_addr;\n"
+           << "}\n\n"
+           << "// 记录一次读（MEM_LOAD）、写（MEM_STORE）或读改写（MEM_UPDATE）访问。访存模式与\n"
+           << "// __mem_record相同，另外把读和写分别计入各自的次数与步长表，统计线程间共享时记下触及的字节\n"
+           << "MEM_API void __mem_record_kind(mem_profile_t* prof, void* addr, int kind) {\n"
+           << "    __mem_record(prof, addr);\n"
+           << "#if MEM_SHARING\n"
+           << "    __mem_share(prof, (size_t)addr, kind);\n"
+           << "#endif\n"
+           << "#if MEM_LOAD_STORE\n"
+           << "    if (kind != MEM_STORE)\n"
+           << "        __mem_kind(prof, MEM_LOAD, (size_t)addr, 0, 1);\n"
+           << "    if (kind != MEM_LOAD)\n"
+           << "        __mem_kind(prof, MEM_STORE, (size_t)addr, 0, 1);\n"
+           << "#else\n"
+           << "    (void)kind;\n"
+           << "#endif\n"
+           << "}\n\n"
+           << "#if MEM_DIM_STRIDES\n"
+           << "// 把count次第d维下标的变化delta计入该维的表，表满时替换计数最小的表项\n"
+           << "static inline void __mem_dim_step(mem_profile_t* prof, int d, long delta, size_t count) {\n"
+           << "    int i, victim = 0;\n"
+           << "    for (i = 0; i < MEM_DIM_PATTERNS; i++) {\n"
+           << "        if (prof->dim_steps[d][i] == delta) break;\n"
+           << "        if (prof->dim_counts[d][i] < prof->dim_counts[d][victim])\n"
+           << "            victim = i;\n"
+           << "    }\n"
+           << "    if (i == MEM_DIM_PATTERNS) {\n"
+           << "        i = victim;\n"
+           << "        prof->dim_steps[d][i] = delta;\n"
+           << "        prof->dim_counts[d][i] = 0;\n"
+           << "    }\n"
+           << "    prof->dim_counts[d][i] += count;\n"
+           << "}\n"
+           << "#endif\n\n"
+           << "// 记录一次多维数组访问的各维下标（由外向内，未用的维为0），紧跟在同一访问的记录调用之后。\n"
+           << "// 各维的下标变化由相邻两次访问的下标直接相减得到，不受采样影响\n"
+           << "MEM_API void __mem_index(mem_profile_t* prof, int dims, long i0, long i1, long i2, long i3) {\n"
+           << "#if MEM_DIM_STRIDES\n"
+           << "    long index[MEM_MAX_DIMS] = {i0, i1, i2, i3};\n"
+           << "    int d;\n"
+           << "    prof->dims = dims;\n"
+           << "    for (d = 0; d < dims; d++) {\n"
+           << "        if (prof->dim_accesses > 0 && index[d] != prof->dim_last[d]) {\n"
+           << "            prof->dim_moves[d]++;\n"
+           << "            __mem_dim_step(prof, d, index[d] - prof->dim_last[d], 1);\n"
+           << "        }\n"
+           << "        prof->dim_last[d] = index[d];\n"
+           << "    }\n"
+           << "    prof->dim_accesses++;\n"
+           << "#else\n"
+           << "    (void)prof; (void)dims; (void)i0; (void)i1; (void)i2; (void)i3;\n"
+           << "#endif\n"
+           << "}\n\n"
+           << "// 多维数组仿射循环访问的各维下标：第一次迭代的下标为i0..i3，之后每次迭代各维分别变化\n"
+           << "// s0..s3，共count次\n"
+           << "MEM_API void __mem_index_affine(mem_profile_t* prof, int dims, long i0, long i1, long i2, long i3,\n"
+           << "                                long s0, long s1, long s2, long s3, long count) {\n"
+           << "#if MEM_DIM_STRIDES\n"
+           << "    long step[MEM_MAX_DIMS] = {s0, s1, s2, s3};\n"
+           << "    int d;\n"
+           << "    if (count <= 0) return;\n"
+           << "    __mem_index(prof, dims, i0, i1, i2, i3);\n"
+           << "    for (d = 0; d < dims; d++) {\n"
+           << "        if (count > 1 && step[d] != 0) {\n"
+           << "            prof->dim_moves[d] += (size_t)(count - 1);\n"
+           << "            __mem_dim_step(prof, d, step[d], (size_t)(count - 1));\n"
            << "        }\n"
+           << "        prof->dim_last[d] += step[d] * (count - 1);\n"
+           << "    }\n"
+           << "    prof->dim_accesses += (size_t)(count - 1);\n"
+           << "#else\n"
+           << "    (void)prof; (void)dims; (void)i0; (void)i1; (void)i2; (void)i3;\n"
+           << "    (void)s0; (void)s1; (void)s2; (void)s3; (void)count;\n"
+           << "#endif\n"
+           << "}\n\n"
+           << "// 带读写类别的仿射循环访问摘要\n"
+           << "MEM_API void __mem_record_affine_kind(mem_profile_t* prof, void* first, long stride, long count, int kind) {\n"
+           << "    __mem_record_affine(prof, first, stride, count);\n"
+           << "#if MEM_SHARING\n"
+           << "    if (count > 0) {\n"
+           << "        size_t step = (size_t)(stride < 0 ? -stride : stride) * prof->type_size;\n"
+           << "        __mem_share_range(prof, stride < 0 ? (size_t)first - (size_t)(count - 1) * step : (size_t)first,\n"
+           << "            step, (size_t)count, kind);\n"
            << "    }\n"
+           << "#endif\n"
+           << "#if MEM_LOAD_STORE\n"
+           << "    if (count <= 0) return;\n"
+           << "    if (kind != MEM_STORE)\n"
+           << "        __mem_kind(prof, MEM_LOAD, (size_t)first, stride, (size_t)count);\n"
+           << "    if (kind != MEM_LOAD)\n"
+           << "        __mem_kind(prof, MEM_STORE, (size_t)first, stride, (size_t)count);\n"
+           << "#else\n"
+           << "    (void)kind;\n"
+           << "#endif\n"
            << "}\n\n";
         return ss.str();
     }
@@ -138,14 +1468,39 @@ public:
     {
         std::stringstream ss;
         ss << "// 分析访存结果\n"
-           << "static inline void __mem_analyze(mem_profile_t* prof) {\n"
+           << "MEM_API void __mem_analyze(mem_profile_t* prof) {\n"
            << "    int i, j;\n"
            << "    if(prof->total_accesses == 0) return;\n"
+           << "#if MEM_BATCH_SIZE > 0\n"
+           << "    __mem_flush(prof);\n"
+           << "#endif\n"
+           << "    // 最后一段连续访问在排序打乱模式表之前结束\n"
+           << "    __mem_run_close(prof);\n"
+           << "#if MEM_PHASE_WINDOW > 0\n"
+           << "    // 最后一个窗口在排序打乱模式表之前结束\n"
+           << "    __mem_phase_close(prof, prof->total_accesses);\n"
+           << "#endif\n"
            << "    \n"
            << "    // 计算变量大小（以Bytes为单位）\n"
            << "    prof->var_size = (prof->end_addr - prof->base_addr + prof->type_size);\n"
            << "    \n"
-           << "    // 选择排序，按照pattern_counts从大到小排序，同时调整patterns数组\n"
+           << "#if MEM_SAMPLE_PERIOD > 1 && !MEM_COMPACT\n"
+           << "    // 将采样得到的模式计数按比例还原为逐次记录的访问次数下的估计值，仿射摘要的精确计数不变。\n"
+           << "    // 还原后的计数都视为精确计数，之后再采样的访问在下次分析时单独还原\n"
+           << "    if(prof->sampled_accesses > 0) {\n"
+           << "        double ratio = (double)(prof->total_accesses - prof->exact_accesses) / prof->sampled_accesses;\n"
+           << "        for(i = 0; i < MEM_MAX_PATTERNS; i++) {\n"
+           << "            prof->pattern_counts[i] = prof->pattern_exact[i] +\n"
+           << "                (size_t)((double)(prof->pattern_counts[i] - prof->pattern_exact[i]) * ratio);\n"
+           << "            prof->pattern_errors[i] = (size_t)((double)prof->pattern_errors[i] * ratio);\n"
+           << "            prof->pattern_exact[i] = prof->pattern_counts[i];\n"
+           << "        }\n"
+           << "        prof->exact_accesses = prof->total_accesses;\n"
+           << "        prof->sampled_accesses = 0;\n"
+           << "    }\n"
+           << "#endif\n"
+           << "    \n"
+           << "    // 选择排序，按照pattern_counts从大到小排序，同时调整patterns和pattern_errors数组\n"
            << "    for(i = 0; i < MEM_TOP_PATTERNS && i < MEM_MAX_PATTERNS - 1; i++) {\n"
            << "        int max_idx = i;\n"
            << "        for(j = i + 1; j < MEM_MAX_PATTERNS; j++) {\n"
@@ -155,52 +1510,999 @@ public:
            << "        }\n"
            << "        if(max_idx != i) {\n"
            << "            // 交换pattern_counts\n"
-           << "            size_t temp_count = prof->pattern_counts[i];\n"
+           << "            mem_count_t temp_count = prof->pattern_counts[i];\n"
            << "            prof->pattern_counts[i] = prof->pattern_counts[max_idx];\n"
            << "            prof->pattern_counts[max_idx] = temp_count;\n"
            << "            \n"
            << "            // 同步交换patterns\n"
-           << "            size_t temp_pattern = prof->patterns[i];\n"
+           << "            mem_step_t temp_pattern = prof->patterns[i];\n"
            << "            prof->patterns[i] = prof->patterns[max_idx];\n"
            << "            prof->patterns[max_idx] = temp_pattern;\n"
+           << "            \n"
+           << "            mem_count_t temp_error = prof->pattern_errors[i];\n"
+           << "            prof->pattern_errors[i] = prof->pattern_errors[max_idx];\n"
+           << "            prof->pattern_errors[max_idx] = temp_error;\n"
+           << "#if MEM_SAMPLE_PERIOD > 1\n"
+           << "            mem_count_t temp_exact = prof->pattern_exact[i];\n"
+           << "            prof->pattern_exact[i] = prof->pattern_exact[max_idx];\n"
+           << "            prof->pattern_exact[max_idx] = temp_exact;\n"
+           << "#endif\n"
+           << "        }\n"
+           << "    }\n"
+           << "    \n"
+           << "    // 嵌套模式按覆盖的访问次数从大到小排序\n"
+           << "    for(i = 0; i < MEM_MAX_NESTED - 1; i++) {\n"
+           << "        int max_idx = i;\n"
+           << "        for(j = i + 1; j < MEM_MAX_NESTED; j++) {\n"
+           << "            if((size_t)prof->nested_counts[j] * (prof->nested_lens[j] + 1) >\n"
+           << "               (size_t)prof->nested_counts[max_idx] * (prof->nested_lens[max_idx] + 1)) {\n"
+           << "                max_idx = j;\n"
+           << "            }\n"
+           << "        }\n"
+           << "        if(max_idx != i) {\n"
+           << "            mem_step_t temp_step = prof->nested_steps[i];\n"
+           << "            size_t temp_len = prof->nested_lens[i];\n"
+           << "            mem_step_t temp_jump = prof->nested_jumps[i];\n"
+           << "            mem_count_t temp_count = prof->nested_counts[i];\n"
+           << "            prof->nested_steps[i] = prof->nested_steps[max_idx];\n"
+           << "            prof->nested_lens[i] = prof->nested_lens[max_idx];\n"
+           << "            prof->nested_jumps[i] = prof->nested_jumps[max_idx];\n"
+           << "            prof->nested_counts[i] = prof->nested_counts[max_idx];\n"
+           << "            prof->nested_steps[max_idx] = temp_step;\n"
+           << "            prof->nested_lens[max_idx] = temp_len;\n"
+           << "            prof->nested_jumps[max_idx] = temp_jump;\n"
+           << "            prof->nested_counts[max_idx] = temp_count;\n"
            << "        }\n"
            << "    }\n"
+           << "#if MEM_LOAD_STORE\n"
+           << "    \n"
+           << "    // 读、写的步长表各自按次数从大到小排序\n"
+           << "    for (int kind = 0; kind < 2; kind++) {\n"
+           << "        for(i = 1; i < MEM_KIND_PATTERNS; i++) {\n"
+           << "            long step = prof->kind_steps[kind][i];\n"
+           << "            size_t count = prof->kind_counts[kind][i];\n"
+           << "            for(j = i; j > 0 && prof->kind_counts[kind][j - 1] < count; j--) {\n"
+           << "                prof->kind_steps[kind][j] = prof->kind_steps[kind][j - 1];\n"
+           << "                prof->kind_counts[kind][j] = prof->kind_counts[kind][j - 1];\n"
+           << "            }\n"
+           << "            prof->kind_steps[kind][j] = step;\n"
+           << "            prof->kind_counts[kind][j] = count;\n"
+           << "        }\n"
+           << "    }\n"
+           << "#endif\n"
+           << "#if MEM_DIM_STRIDES\n"
+           << "    \n"
+           << "    // 各维的下标变化表按次数从大到小排序\n"
+           << "    for (int d = 0; d < prof->dims; d++) {\n"
+           << "        for(i = 1; i < MEM_DIM_PATTERNS; i++) {\n"
+           << "            long step = prof->dim_steps[d][i];\n"
+           << "            size_t count = prof->dim_counts[d][i];\n"
+           << "            for(j = i; j > 0 && prof->dim_counts[d][j - 1] < count; j--) {\n"
+           << "                prof->dim_steps[d][j] = prof->dim_steps[d][j - 1];\n"
+           << "                prof->dim_counts[d][j] = prof->dim_counts[d][j - 1];\n"
+           << "            }\n"
+           << "            prof->dim_steps[d][j] = step;\n"
+           << "            prof->dim_counts[d][j] = count;\n"
+           << "        }\n"
+           << "    }\n"
+           << "#endif\n"
+           << "}\n\n";
+        return ss.str();
+    }
+
+    // 生成二进制记录输出函数
+    static std::string generateDumpFunction()
+    {
+        std::stringstream ss;
+        ss << "// 按小端序把整数v的低n个字节写入buf\n"
+           << "static inline int __mem_put(unsigned char* buf, int pos, unsigned long long v, int n) {\n"
+           << "    for (int i = 0; i < n; i++)\n"
+           << "        buf[pos + i] = (unsigned char)(v >> (8 * i));\n"
+           << "    return pos + n;\n"
+           << "}\n\n"
+           << "static inline int __mem_name_len(const char* name) {\n"
+           << "    int n = 0;\n"
+           << "    while (n < MEM_NAME_SIZE - 1 && name[n] != '\\0')\n"
+           << "        n++;\n"
+           << "    return n;\n"
            << "}\n\n"
-           << "// 打印分析结果\n"
-           << "static inline void __mem_print_analysis(mem_profile_t* prof) {\n"
+           << "// 各线程输出二进制记录的缓冲区。MT-3000 线程栈很小，记录不在栈上组装；弱定义使内嵌运行时的\n"
+           << "// 各翻译单元共用一份\n"
+           << "__attribute__((weak)) unsigned char __mem_dump_buf[MEM_NUM_THREADS][2 * MEM_DUMP_MAX + 1];\n\n"
+           << "// 以二进制记录输出分析结果（格式见 mem_analysis.py），包含全部模式的精确计数：\n"
+           << "//   u32 magic, u16 version, u16 thread_id, u16 var_name_len, u16 func_name_len,\n"
+           << "//   u16 pattern_count, u16 sample_burst, u32 sample_period, u32 type_size,\n"
+           << "//   u64 base_addr, u64 end_addr, u64 total_accesses, var_name, func_name,\n"
+           << "//   pattern_count * {i64 step, u64 count, u64 error}, u16 nested_count,\n"
+           << "//   nested_count * {i64 step, u64 length, i64 jump, u64 count}, u16 heat_bins,\n"
+           << "//   [u64 heat_base, u64 bucket_bytes, heat_bins * u64 count]（heat_bins为0时省略）,\n"
+           << "//   u16 phase_count, u16 phase_top,\n"
+           << "//   phase_count * {u64 start, u64 accesses, u64 analyzed, u64 low, u64 high,\n"
+           << "//                  phase_top * {i64 step, u64 count}}, u64 cycles,\n"
+           << "//   u64 loads, u64 stores, u16 kind_top, 2 * kind_top * {i64 step, u64 count}（先读后写）,\n"
+           << "//   u16 run_bins, [i64 run_step, u64 runs, u64 run_total, u64 run_max, run_bins * u64 count]\n"
+           << "//   （run_bins为0时省略）, u16 dims, [u16 dim_top, u64 indexed_accesses,\n"
+           << "//   dims * {u64 moves, dim_top * {i64 step, u64 count}}]（dims为0时省略）, u32 loop_line,\n"
+           << "//   u32 share_line, [u64 shared_read, u64 shared_write, u64 false_sharing, u16 false_count,\n"
+           << "//   false_count * i64 offset]（share_line为0时省略）, u16 reuse_bins,\n"
+           << "//   [u32 line_size, reuse_bins * u64 count]（最后一格为首次访问，reuse_bins为0时省略）\n"
+           << "static inline void __mem_dump(mem_profile_t* prof) {\n"
+           << "    // 记录随分析项增多可达数KB，不放在线程栈上；十六进制输出时在同一缓冲区内从后向前原地展开\n"
+           << "    unsigned char* buf = __mem_dump_buf[__mem_thread_id()];\n"
+           << "    int pos = 0, i, n = 0;\n"
+           << "    int name_len = __mem_name_len(prof->var_name);\n"
+           << "    int func_len = __mem_name_len(prof->func_name);\n"
+           << "    double scale = __mem_count_scale(prof, -1);\n"
+           << "    if (prof->total_accesses == 0) return;\n"
+           << "    \n"
+           << "    for (i = 0; i < MEM_MAX_PATTERNS; i++) {\n"
+           << "        if (prof->patterns[i] != MEM_EMPTY_PATTERN)\n"
+           << "            n++;\n"
+           << "    }\n"
+           << "    pos = __mem_put(buf, pos, MEM_DUMP_MAGIC, 4);\n"
+           << "    pos = __mem_put(buf, pos, MEM_DUMP_VERSION, 2);\n"
+           << "    pos = __mem_put(buf, pos, __mem_thread_id(), 2);\n"
+           << "    pos = __mem_put(buf, pos, name_len, 2);\n"
+           << "    pos = __mem_put(buf, pos, func_len, 2);\n"
+           << "    pos = __mem_put(buf, pos, n, 2);\n"
+           << "    pos = __mem_put(buf, pos, MEM_SAMPLE_BURST, 2);\n"
+           << "    pos = __mem_put(buf, pos, MEM_SAMPLE_PERIOD, 4);\n"
+           << "    pos = __mem_put(buf, pos, prof->type_size, 4);\n"
+           << "    pos = __mem_put(buf, pos, prof->base_addr, 8);\n"
+           << "    pos = __mem_put(buf, pos, prof->end_addr, 8);\n"
+           << "    pos = __mem_put(buf, pos, prof->total_accesses, 8);\n"
+           << "    memcpy(buf + pos, prof->var_name, name_len);\n"
+           << "    pos += name_len;\n"
+           << "    memcpy(buf + pos, prof->func_name, func_len);\n"
+           << "    pos += func_len;\n"
+           << "    for (i = 0; i < MEM_MAX_PATTERNS; i++) {\n"
+           << "        if (prof->patterns[i] == MEM_EMPTY_PATTERN)\n"
+           << "            continue;\n"
+           << "        double pattern_scale = __mem_count_scale(prof, i);\n"
+           << "        pos = __mem_put(buf, pos, prof->patterns[i], 8);\n"
+           << "        pos = __mem_put(buf, pos, (unsigned long long)(prof->pattern_counts[i] * pattern_scale), 8);\n"
+           << "        pos = __mem_put(buf, pos, (unsigned long long)(prof->pattern_errors[i] * pattern_scale), 8);\n"
+           << "    }\n"
+           << "    for (i = 0, n = 0; i < MEM_MAX_NESTED; i++)\n"
+           << "        n += prof->nested_counts[i] > 0;\n"
+           << "    pos = __mem_put(buf, pos, n, 2);\n"
+           << "    for (i = 0; i < MEM_MAX_NESTED; i++) {\n"
+           << "        if (prof->nested_counts[i] == 0)\n"
+           << "            continue;\n"
+           << "        pos = __mem_put(buf, pos, prof->nested_steps[i], 8);\n"
+           << "        pos = __mem_put(buf, pos, prof->nested_lens[i], 8);\n"
+           << "        pos = __mem_put(buf, pos, prof->nested_jumps[i], 8);\n"
+           << "        pos = __mem_put(buf, pos, (unsigned long long)(prof->nested_counts[i] * scale), 8);\n"
+           << "    }\n"
+           << "#if MEM_HEAT_MAP\n"
+           << "    {\n"
+           << "        // 热度计数只包含被分析的访问，按总访问次数还原\n"
+           << "        size_t heat_total = 0;\n"
+           << "        for (i = 0; i < MEM_HEAT_BINS; i++)\n"
+           << "            heat_total += prof->heat[i];\n"
+           << "        pos = __mem_put(buf, pos, MEM_HEAT_BINS, 2);\n"
+           << "        pos = __mem_put(buf, pos, prof->heat_base, 8);\n"
+           << "        pos = __mem_put(buf, pos, (size_t)1 << prof->heat_shift, 8);\n"
+           << "        for (i = 0; i < MEM_HEAT_BINS; i++) {\n"
+           << "            pos = __mem_put(buf, pos, heat_total == 0 ? 0 :\n"
+           << "                (unsigned long long)((double)prof->heat[i] * prof->total_accesses / heat_total), 8);\n"
+           << "        }\n"
+           << "    }\n"
+           << "#else\n"
+           << "    pos = __mem_put(buf, pos, 0, 2);\n"
+           << "#endif\n"
+           << "#if MEM_PHASE_WINDOW > 0\n"
+           << "    // 阶段的起止以全部访问计，步长次数只包含被分析的访问\n"
+           << "    n = prof->phase_count < MEM_MAX_PHASES ? prof->phase_count : MEM_MAX_PHASES;\n"
+           << "    pos = __mem_put(buf, pos, n, 2);\n"
+           << "    pos = __mem_put(buf, pos, MEM_PHASE_TOP, 2);\n"
+           << "    for (i = prof->phase_count - n; i < prof->phase_count; i++) {\n"
+           << "        mem_phase_t* phase = &prof->phases[i % MEM_MAX_PHASES];\n"
+           << "        pos = __mem_put(buf, pos, phase->start, 8);\n"
+           << "        pos = __mem_put(buf, pos, phase->accesses, 8);\n"
+           << "        pos = __mem_put(buf, pos, phase->analyzed, 8);\n"
+           << "        pos = __mem_put(buf, pos, phase->low, 8);\n"
+           << "        pos = __mem_put(buf, pos, phase->high, 8);\n"
+           << "        for (int k = 0; k < MEM_PHASE_TOP; k++) {\n"
+           << "            pos = __mem_put(buf, pos, phase->steps[k], 8);\n"
+           << "            pos = __mem_put(buf, pos, phase->counts[k], 8);\n"
+           << "        }\n"
+           << "    }\n"
+           << "#else\n"
+           << "    pos = __mem_put(buf, pos, 0, 2);\n"
+           << "    pos = __mem_put(buf, pos, 0, 2);\n"
+           << "#endif\n"
+           << "#if MEM_TIMING\n"
+           << "    pos = __mem_put(buf, pos, prof->cycles, 8);\n"
+           << "#else\n"
+           << "    pos = __mem_put(buf, pos, 0, 8);\n"
+           << "#endif\n"
+           << "#if MEM_LOAD_STORE\n"
+           << "    pos = __mem_put(buf, pos, prof->kind_accesses[MEM_LOAD], 8);\n"
+           << "    pos = __mem_put(buf, pos, prof->kind_accesses[MEM_STORE], 8);\n"
+           << "    pos = __mem_put(buf, pos, MEM_KIND_PATTERNS, 2);\n"
+           << "    for (n = 0; n < 2; n++) {\n"
+           << "        for (i = 0; i < MEM_KIND_PATTERNS; i++) {\n"
+           << "            pos = __mem_put(buf, pos, prof->kind_steps[n][i], 8);\n"
+           << "            pos = __mem_put(buf, pos, prof->kind_counts[n][i], 8);\n"
+           << "        }\n"
+           << "    }\n"
+           << "#else\n"
+           << "    pos = __mem_put(buf, pos, 0, 8);\n"
+           << "    pos = __mem_put(buf, pos, 0, 8);\n"
+           << "    pos = __mem_put(buf, pos, 0, 2);\n"
+           << "#endif\n"
+           << "#if MEM_RUN_LENGTHS\n"
+           << "    pos = __mem_put(buf, pos, prof->runs > 0 ? MEM_RUN_BINS : 0, 2);\n"
+           << "    if (prof->runs > 0) {\n"
+           << "        pos = __mem_put(buf, pos, prof->run_hist_step, 8);\n"
+           << "        pos = __mem_put(buf, pos, prof->runs, 8);\n"
+           << "        pos = __mem_put(buf, pos, prof->run_total, 8);\n"
+           << "        pos = __mem_put(buf, pos, prof->run_max, 8);\n"
+           << "        for (i = 0; i < MEM_RUN_BINS; i++)\n"
+           << "            pos = __mem_put(buf, pos, prof->run_hist[i], 8);\n"
+           << "    }\n"
+           << "#else\n"
+           << "    pos = __mem_put(buf, pos, 0, 2);\n"
+           << "#endif\n"
+           << "#if MEM_DIM_STRIDES\n"
+           << "    pos = __mem_put(buf, pos, prof->dims, 2);\n"
+           << "    if (prof->dims > 0) {\n"
+           << "        pos = __mem_put(buf, pos, MEM_DIM_PATTERNS, 2);\n"
+           << "        pos = __mem_put(buf, pos, prof->dim_accesses, 8);\n"
+           << "        for (n = 0; n < prof->dims; n++) {\n"
+           << "            pos = __mem_put(buf, pos, prof->dim_moves[n], 8);\n"
+           << "            for (i = 0; i < MEM_DIM_PATTERNS; i++) {\n"
+           << "                pos = __mem_put(buf, pos, prof->dim_steps[n][i], 8);\n"
+           << "                pos = __mem_put(buf, pos, prof->dim_counts[n][i], 8);\n"
+           << "            }\n"
+           << "        }\n"
+           << "    }\n"
+           << "#else\n"
+           << "    pos = __mem_put(buf, pos, 0, 2);\n"
+           << "#endif\n"
+           << "#if MEM_LOOP_SITES\n"
+           << "    pos = __mem_put(buf, pos, prof->loop_line, 4);\n"
+           << "#else\n"
+           << "    pos = __mem_put(buf, pos, 0, 4);\n"
+           << "#endif\n"
+           << "#if MEM_SHARING\n"
+           << "    if (prof->merged_threads > 1 && prof->share_count > 0) {\n"
+           << "        size_t counts[3], from = 0;\n"
+           << "        int slot, count_pos;\n"
+           << "        __mem_share_counts(prof, counts);\n"
+           << "        pos = __mem_put(buf, pos, MEM_SHARE_LINE, 4);\n"
+           << "        for (i = 0; i < 3; i++)\n"
+           << "            pos = __mem_put(buf, pos, counts[i], 8);\n"
+           << "        count_pos = pos;\n"
+           << "        pos += 2;\n"
+           << "        for (n = 0; n < MEM_SHARE_TOP && (slot = __mem_false_line(prof, from)) >= 0; n++) {\n"
+           << "            pos = __mem_put(buf, pos, prof->share_lines[slot] * MEM_SHARE_LINE - prof->base_addr, 8);\n"
+           << "            from = prof->share_lines[slot] + 1;\n"
+           << "        }\n"
+           << "        __mem_put(buf, count_pos, n, 2);\n"
+           << "    } else {\n"
+           << "        pos = __mem_put(buf, pos, 0, 4);\n"
+           << "    }\n"
+           << "#else\n"
+           << "    pos = __mem_put(buf, pos, 0, 4);\n"
+           << "#endif\n"
+           << "#if MEM_REUSE_DISTANCE\n"
+           << "    // 各格计数已按缓存行的采样率还原，只包含被分析的访问\n"
+           << "    pos = __mem_put(buf, pos, MEM_REUSE_BINS + 1, 2);\n"
+           << "    pos = __mem_put(buf, pos, MEM_LINE_SIZE, 4);\n"
+           << "    for (i = 0; i <= MEM_REUSE_BINS; i++)\n"
+           << "        pos = __mem_put(buf, pos, prof->reuse_hist[i], 8);\n"
+           << "#else\n"
+           << "    pos = __mem_put(buf, pos, 0, 2);\n"
+           << "#endif\n"
+           << "    \n"
+           << "#if defined(MEM_DUMP_FILE) && MEM_BACKEND != MEM_BACKEND_DEVICE\n"
+           << "    // 主机端可直接追加写入二进制文件\n"
+           << "    FILE* fp = fopen(MEM_DUMP_FILE, \"ab\");\n"
+           << "    if (fp) {\n"
+           << "        fwrite(buf, 1, pos, fp);\n"
+           << "        fclose(fp);\n"
+           << "    }\n"
+           << "#else\n"
+           << "    for (i = pos - 1; i >= 0; i--) {\n"
+           << "        unsigned char byte = buf[i];\n"
+           << "        buf[2 * i] = \"0123456789abcdef\"[byte >> 4];\n"
+           << "        buf[2 * i + 1] = \"0123456789abcdef\"[byte & 15];\n"
+           << "    }\n"
+           << "    buf[2 * pos] = '\\0';\n"
+           << "    __mem_printf(\"[Memory Profile] %s\\n\", (char*)buf);\n"
+           << "#endif\n"
+           << "}\n";
+        return ss.str();
+    }
+
+    // 生成结果打印函数
+    static std::string generatePrintFunction()
+    {
+        std::stringstream ss;
+        ss << "// 打印分析结果\n"
+           << "MEM_API void __mem_print_analysis(mem_profile_t* prof) {\n"
            << "    if(prof->total_accesses == 0) return;\n"
+           << "#if MEM_OUTPUT_FORMAT == MEM_OUTPUT_BINARY\n"
+           << "    __mem_dump(prof);\n"
+           << "    return;\n"
+           << "#endif\n"
            << "    \n"
            << "    // 创建输出缓冲区\n"
-           << "    char buffer[512];\n"
+           << "    char buffer[2048];\n"
            << "    int offset = 0;\n"
+           << "    double scale = __mem_count_scale(prof, -1);\n"
            << "    \n"
            << "    // 写入基本信息\n"
            << "    offset += snprintf(buffer + offset, sizeof(buffer) - offset,\n"
-           << "        \"[Memory Analysis] thread %d: %s in %s: elements=%zu, accesses=%zu\\n\",\n"
-           << "        get_thread_id(), prof->var_name, prof->func_name, prof->var_size, prof->total_accesses);\n"
+           << "        \"[Memory Analysis] thread %d: %s in %s\", __mem_thread_id(), prof->var_name, prof->func_name);\n"
+           << "#if MEM_LOOP_SITES\n"
+           << "    if(prof->loop_line > 0)\n"
+           << "        offset += snprintf(buffer + offset, sizeof(buffer) - offset, \", loop at line %u\", prof->loop_line);\n"
+           << "#endif\n"
+           << "    offset += snprintf(buffer + offset, sizeof(buffer) - offset, \": elements=%zu, accesses=%zu\",\n"
+           << "        prof->var_size, prof->total_accesses);\n"
+           << "#if MEM_SAMPLE_PERIOD > 1\n"
+           << "    offset += snprintf(buffer + offset, sizeof(buffer) - offset, \", sampling=%d/%d\",\n"
+           << "        MEM_SAMPLE_BURST, MEM_SAMPLE_PERIOD);\n"
+           << "#endif\n"
+           << "    if(prof->merged_threads > 1) {\n"
+           << "        offset += snprintf(buffer + offset, sizeof(buffer) - offset, \", threads=%d\",\n"
+           << "            prof->merged_threads);\n"
+           << "    }\n"
+           << "#if MEM_TIMING\n"
+           << "    // 每周期访问的字节数：访问次数乘元素大小，除以所在函数的周期数\n"
+           << "    if(prof->cycles > 0) {\n"
+           << "        offset += snprintf(buffer + offset, sizeof(buffer) - offset, \", cycles=%llu, bytes/cycle=%.3f\",\n"
+           << "            prof->cycles, (double)prof->total_accesses * prof->type_size / prof->cycles);\n"
+           << "    }\n"
+           << "#endif\n"
+           << "    offset += snprintf(buffer + offset, sizeof(buffer) - offset, \"\\n\");\n"
            << "    \n"
            << "    // 输出主要访存模式\n"
            << "    for(int i = 0; i < MEM_TOP_PATTERNS && i < MEM_MAX_PATTERNS; i++) {\n"
-           << "        if(prof->pattern_counts[i] > prof->total_accesses * 5 / 100) {\n"
+           << "        double pattern_scale = __mem_count_scale(prof, i);\n"
+           << "        if(prof->pattern_counts[i] * pattern_scale > prof->total_accesses * 5 / 100) {\n"
            << "            offset += snprintf(buffer + offset, sizeof(buffer) - offset,\n"
-           << "                \"  Pattern %d: step=%zu (%.1f%%)\\n\",\n"
+           << "                \"  Pattern %d: step=%ld (%.1f%%)\",\n"
            << "                i + 1,\n"
-           << "                prof->patterns[i],\n"
-           << "                (float)prof->pattern_counts[i] * 100 / prof->total_accesses);\n"
+           << "                (long)prof->patterns[i],\n"
+           << "                (float)(prof->pattern_counts[i] * pattern_scale) * 100 / prof->total_accesses);\n"
+           << "            // 表满后被替换进来的模式附带误差上界\n"
+           << "            if(prof->pattern_errors[i] > 0) {\n"
+           << "                offset += snprintf(buffer + offset, sizeof(buffer) - offset, \" error<=%.1f%%\",\n"
+           << "                    (float)(prof->pattern_errors[i] * pattern_scale) * 100 / prof->total_accesses);\n"
+           << "            }\n"
+           << "            offset += snprintf(buffer + offset, sizeof(buffer) - offset, \"\\n\");\n"
            << "        }\n"
            << "    }\n"
            << "    \n"
+           << "#if MEM_RUN_LENGTHS\n"
+           << "    // 输出跟踪步长的连续段：段数、平均与最长元素数，以及按元素数对数分桶的段数占比\n"
+           << "    if(prof->runs > 0) {\n"
+           << "        offset += snprintf(buffer + offset, sizeof(buffer) - offset,\n"
+           << "            \"  Runs of step=%ld: %zu runs, mean=%.1f, max=%zu, lengths:\",\n"
+           << "            (long)prof->run_hist_step, prof->runs, (double)prof->run_total / prof->runs, prof->run_max);\n"
+           << "        for(int i = 0; i < MEM_RUN_BINS && offset < (int)sizeof(buffer); i++) {\n"
+           << "            size_t lo = (size_t)1 << i;\n"
+           << "            if(prof->run_hist[i] == 0) continue;\n"
+           << "            if(i == MEM_RUN_BINS - 1)\n"
+           << "                offset += snprintf(buffer + offset, sizeof(buffer) - offset, \" %zu+\", lo);\n"
+           << "            else if(i == 0)\n"
+           << "                offset += snprintf(buffer + offset, sizeof(buffer) - offset, \" 1\");\n"
+           << "            else\n"
+           << "                offset += snprintf(buffer + offset, sizeof(buffer) - offset, \" %zu-%zu\", lo, 2 * lo - 1);\n"
+           << "            if(offset < (int)sizeof(buffer)) {\n"
+           << "                offset += snprintf(buffer + offset, sizeof(buffer) - offset, \"=%.1f%%\",\n"
+           << "                    (float)prof->run_hist[i] * 100 / prof->runs);\n"
+           << "            }\n"
+           << "        }\n"
+           << "        if(offset < (int)sizeof(buffer))\n"
+           << "            offset += snprintf(buffer + offset, sizeof(buffer) - offset, \"\\n\");\n"
+           << "    }\n"
+           << "#endif\n"
+           << "    \n"
+           << "    // 输出覆盖超过5%访问的嵌套模式\n"
+           << "    for(int i = 0; i < MEM_MAX_NESTED && offset < (int)sizeof(buffer); i++) {\n"
+           << "        size_t covered = (size_t)(prof->nested_counts[i] * scale) * (prof->nested_lens[i] + 1);\n"
+           << "        if(prof->nested_counts[i] > 0 && covered > prof->total_accesses * 5 / 100) {\n"
+           << "            offset += snprintf(buffer + offset, sizeof(buffer) - offset,\n"
+           << "                \"  Nested %d: %zu x step=%ld, then step=%ld (%.1f%%)\\n\",\n"
+           << "                i + 1,\n"
+           << "                prof->nested_lens[i],\n"
+           << "                (long)prof->nested_steps[i],\n"
+           << "                (long)prof->nested_jumps[i],\n"
+           << "                (float)covered * 100 / prof->total_accesses);\n"
+           << "        }\n"
+           << "    }\n"
+           << "    \n"
+           << "#if MEM_DIM_STRIDES\n"
+           << "    // 多维数组各维最频繁的下标变化和下标发生变化的访问占比。变化最频繁的维不是最后一维（连续的\n"
+           << "    // 一维），且最后一维每变化一次它至少变化8次时，最内层循环走的是跨度大的维，提示交换循环\n"
+           << "    if (prof->dims > 1 && prof->dim_accesses > 0) {\n"
+           << "        int fast = 0, last = prof->dims - 1;\n"
+           << "        for (int d = 0; d < prof->dims && offset < (int)sizeof(buffer); d++) {\n"
+           << "            if (prof->dim_moves[d] > prof->dim_moves[fast])\n"
+           << "                fast = d;\n"
+           << "            if (prof->dim_moves[d] == 0) {\n"
+           << "                offset += snprintf(buffer + offset, sizeof(buffer) - offset, \"  Dimension %d: unchanged\\n\", d);\n"
+           << "                continue;\n"
+           << "            }\n"
+           << "            offset += snprintf(buffer + offset, sizeof(buffer) - offset,\n"
+           << "                \"  Dimension %d: step=%ld, changes in %.1f%% of accesses\\n\", d, prof->dim_steps[d][0],\n"
+           << "                (float)prof->dim_moves[d] * 100 / prof->dim_accesses);\n"
+           << "        }\n"
+           << "        if (fast != last && prof->dim_moves[last] > 0 && prof->dim_moves[fast] >= prof->dim_moves[last] * 8 &&\n"
+           << "            prof->dim_moves[fast] * 2 >= prof->dim_accesses && offset < (int)sizeof(buffer)) {\n"
+           << "            offset += snprintf(buffer + offset, sizeof(buffer) - offset,\n"
+           << "                \"  Interchange: innermost loop walks dimension %d; make the loop over dimension %d innermost\\n\",\n"
+           << "                fast, last);\n"
+           << "        }\n"
+           << "    }\n"
+           << "#endif\n"
+           << "    \n"
+           << "#if MEM_LOAD_STORE\n"
+           << "    // 读、写分别输出次数和占该类别5%以上的步长；次数为0说明变量只写或只读\n"
+           << "    for (int kind = 0; kind < 2 && offset < (int)sizeof(buffer); kind++) {\n"
+           << "        size_t kind_total = prof->kind_accesses[kind];\n"
+           << "        offset += snprintf(buffer + offset, sizeof(buffer) - offset, \"  %s: %zu\",\n"
+           << "            kind == MEM_LOAD ? \"Loads\" : \"Stores\", kind_total);\n"
+           << "        for (int i = 0; i < MEM_KIND_PATTERNS && offset < (int)sizeof(buffer); i++) {\n"
+           << "            if (prof->kind_counts[kind][i] * 20 <= kind_total) break;\n"
+           << "            offset += snprintf(buffer + offset, sizeof(buffer) - offset, \", step=%ld (%.1f%%)\",\n"
+           << "                prof->kind_steps[kind][i], (float)prof->kind_counts[kind][i] * 100 / kind_total);\n"
+           << "        }\n"
+           << "        if (offset < (int)sizeof(buffer))\n"
+           << "            offset += snprintf(buffer + offset, sizeof(buffer) - offset, \"\\n\");\n"
+           << "    }\n"
+           << "#endif\n"
+           << "    \n"
+           << "#if MEM_SHARING\n"
+           << "    // 合并了多个线程时输出各类共享的行数，并按地址列出前几个伪共享行相对变量起始地址的偏移\n"
+           << "    if (prof->merged_threads > 1 && prof->share_count > 0 && offset < (int)sizeof(buffer)) {\n"
+           << "        size_t counts[3], from = 0;\n"
+           << "        int slot;\n"
+           << "        __mem_share_counts(prof, counts);\n"
+           << "        offset += snprintf(buffer + offset, sizeof(buffer) - offset,\n"
+           << "            \"  Sharing (%dB lines): read=%zu, write=%zu, false=%zu\", (int)MEM_SHARE_LINE,\n"
+           << "            counts[0], counts[1], counts[2]);\n"
+           << "        for (int k = 0; k < MEM_SHARE_TOP && offset < (int)sizeof(buffer); k++) {\n"
+           << "            if ((slot = __mem_false_line(prof, from)) < 0) break;\n"
+           << "            offset += snprintf(buffer + offset, sizeof(buffer) - offset, \"%s %+ldB\", k == 0 ? \", false at\" : \"\",\n"
+           << "                (long)(prof->share_lines[slot] * MEM_SHARE_LINE - prof->base_addr));\n"
+           << "            from = prof->share_lines[slot] + 1;\n"
+           << "        }\n"
+           << "        if (offset < (int)sizeof(buffer))\n"
+           << "            offset += snprintf(buffer + offset, sizeof(buffer) - offset, \"\\n\");\n"
+           << "    }\n"
+           << "#endif\n"
+           << "#if MEM_REUSE_DISTANCE\n"
+           << "    // 输出重用距离直方图：第k格为距离小于2^k个缓存行（第0格为紧接着重用），最后为首次访问\n"
+           << "    {\n"
+           << "        size_t reuse_total = 0;\n"
+           << "        for (int i = 0; i <= MEM_REUSE_BINS; i++)\n"
+           << "            reuse_total += prof->reuse_hist[i];\n"
+           << "        if (reuse_total > 0) {\n"
+           << "            offset += snprintf(buffer + offset, sizeof(buffer) - offset, \"  Reuse distance:\");\n"
+           << "            for (int i = 0; i < MEM_REUSE_BINS && offset < (int)sizeof(buffer); i++) {\n"
+           << "                if (prof->reuse_hist[i] == 0) continue;\n"
+           << "                offset += snprintf(buffer + offset, sizeof(buffer) - offset, \" <%zuB=%.1f%%\",\n"
+           << "                    ((size_t)1 << i) * MEM_LINE_SIZE, (float)prof->reuse_hist[i] * 100 / reuse_total);\n"
+           << "            }\n"
+           << "            if (offset < (int)sizeof(buffer)) {\n"
+           << "                offset += snprintf(buffer + offset, sizeof(buffer) - offset, \" cold=%.1f%%\\n\",\n"
+           << "                    (float)prof->reuse_hist[MEM_REUSE_BINS] * 100 / reuse_total);\n"
+           << "            }\n"
+           << "        }\n"
+           << "    }\n"
+           << "#endif\n"
+           << "#if MEM_HEAT_MAP\n"
+           << "    // 输出从第一个到最后一个非空桶的访问占比，以及覆盖MEM_HEAT_HOT%访问的最短连续范围，\n"
+           << "    // 偏移相对于第一个非空桶的起始地址\n"
+           << "    {\n"
+           << "        size_t heat_total = 0, width = (size_t)1 << prof->heat_shift, sum = 0, best_sum = 0;\n"
+           << "        int first = -1, last = -1, lo, hi, best_lo = 0, best_hi = -1;\n"
+           << "        for (int i = 0; i < MEM_HEAT_BINS; i++) {\n"
+           << "            heat_total += prof->heat[i];\n"
+           << "            if (prof->heat[i] == 0) continue;\n"
+           << "            if (first < 0) first = i;\n"
+           << "            last = i;\n"
+           << "        }\n"
+           << "        if (heat_total > 0 && offset < (int)sizeof(buffer)) {\n"
+           << "            offset += snprintf(buffer + offset, sizeof(buffer) - offset, \"  Heat map (%zuB buckets from 0x%zx):\",\n"
+           << "                width, prof->heat_base + first * width);\n"
+           << "            for (int i = first; i <= last && offset < (int)sizeof(buffer); i++) {\n"
+           << "                offset += snprintf(buffer + offset, sizeof(buffer) - offset, \" %.1f\",\n"
+           << "                    (float)prof->heat[i] * 100 / heat_total);\n"
+           << "            }\n"
+           << "            // 双指针求计数之和达到阈值的最短窗口\n"
+           << "            for (lo = first, hi = first; hi <= last; hi++) {\n"
+           << "                sum += prof->heat[hi];\n"
+           << "                while ((sum - prof->heat[lo]) * 100 >= heat_total * MEM_HEAT_HOT)\n"
+           << "                    sum -= prof->heat[lo++];\n"
+           << "                if (sum * 100 >= heat_total * MEM_HEAT_HOT && (best_hi < 0 || hi - lo < best_hi - best_lo)) {\n"
+           << "                    best_lo = lo;\n"
+           << "                    best_hi = hi;\n"
+           << "                    best_sum = sum;\n"
+           << "                }\n"
+           << "            }\n"
+           << "            if (offset < (int)sizeof(buffer)) {\n"
+           << "                offset += snprintf(buffer + offset, sizeof(buffer) - offset,\n"
+           << "                    \"\\n  Hot range: +%zuB..+%zuB (%.1f%%)\\n\", (best_lo - first) * width,\n"
+           << "                    (best_hi + 1 - first) * width, (float)best_sum * 100 / heat_total);\n"
+           << "            }\n"
+           << "        }\n"
+           << "    }\n"
+           << "#endif\n"
+           << "#if MEM_PHASE_WINDOW > 0\n"
+           << "    // 访问行为随时间变化时按时间顺序输出各阶段：起止位置（访问次数）、主要步长和访问范围，\n"
+           << "    // 次要步长占1%以上时才输出\n"
+           << "    if (prof->phase_count > 1) {\n"
+           << "        int shown = prof->phase_count < MEM_MAX_PHASES ? prof->phase_count : MEM_MAX_PHASES;\n"
+           << "        if (shown < prof->phase_count && offset < (int)sizeof(buffer)) {\n"
+           << "            offset += snprintf(buffer + offset, sizeof(buffer) - offset, \"  Phases: %d, last %d shown\\n\",\n"
+           << "                prof->phase_count, shown);\n"
+           << "        }\n"
+           << "        for (int i = prof->phase_count - shown; i < prof->phase_count && offset < (int)sizeof(buffer); i++) {\n"
+           << "            mem_phase_t* phase = &prof->phases[i % MEM_MAX_PHASES];\n"
+           << "            offset += snprintf(buffer + offset, sizeof(buffer) - offset, \"  Phase %d: accesses %zu-%zu,%s\",\n"
+           << "                i + 1, phase->start, phase->start + phase->accesses,\n"
+           << "                __mem_phase_key(phase) == MEM_EMPTY_PATTERN ? \" irregular,\" : \"\");\n"
+           << "            for (int k = 0; k < MEM_PHASE_TOP && offset < (int)sizeof(buffer); k++) {\n"
+           << "                if (phase->counts[k] == 0 || (k > 0 && (size_t)phase->counts[k] * 100 < phase->analyzed)) break;\n"
+           << "                offset += snprintf(buffer + offset, sizeof(buffer) - offset, \" step=%ld (%.1f%%),\",\n"
+           << "                    (long)phase->steps[k], (float)phase->counts[k] * 100 / phase->analyzed);\n"
+           << "            }\n"
+           << "            if (offset < (int)sizeof(buffer)) {\n"
+           << "                offset += snprintf(buffer + offset, sizeof(buffer) - offset, \" span=%zuB\\n\",\n"
+           << "                    phase->high - phase->low + prof->type_size);\n"
+           << "            }\n"
+           << "        }\n"
+           << "    }\n"
+           << "#endif\n"
+           << "    \n"
            << "    // 一次性输出所有内容\n"
-           << "    hthread_printf(\"%s\", buffer);\n"
+           << "    __mem_printf(\"%s\", buffer);\n"
+           << "}\n\n"
+           << "// 分析并输出一个函数的全部分析结果，访问次数多的在前（原地排序profs）\n"
+           << "MEM_API void __mem_report_profiles(mem_profile_t** profs, int count) {\n"
+           << "    int i, j;\n"
+           << "    for (i = 1; i < count; i++) {\n"
+           << "        mem_profile_t* prof = profs[i];\n"
+           << "        for (j = i; j > 0 && profs[j - 1]->total_accesses < prof->total_accesses; j--)\n"
+           << "            profs[j] = profs[j - 1];\n"
+           << "        profs[j] = prof;\n"
+           << "    }\n"
+           << "    for (i = 0; i < count; i++) {\n"
+           << "        __mem_analyze(profs[i]);\n"
+           << "        __mem_print_analysis(profs[i]);\n"
+           << "    }\n"
            << "}\n\n";
         return ss.str();
     }
 
-    // 生成完整的访存分析器代码
-    static std::string generateCompleteProfiler(const std::vector<std::string> &includes)
+    // 生成线程归约函数
+    static std::string generateReduceFunction()
+    {
+        std::stringstream ss;
+        ss << "#if MEM_SHARING\n"
+           << "// 逐行比较src与dst（已合并的其他线程）的字节掩码：一方写的字节另一方也访问为共享写；\n"
+           << "// 一方写、另一方只访问同一行中的其他字节为伪共享；双方都读同一字节为共享读。两边的采样阈值\n"
+           << "// 不同时取较小的，只比较双方都跟踪的行；类别标记一经设置不再清除，字节掩码取并集\n"
+           << "static inline void __mem_share_merge(mem_profile_t* dst, mem_profile_t* src) {\n"
+           << "    unsigned long long sr, sw, dr, dw;\n"
+           << "    int i, j, n = 0;\n"
+           << "    if (src->share_threshold < dst->share_threshold)\n"
+           << "        dst->share_threshold = src->share_threshold;\n"
+           << "    for (i = 0; i < dst->share_count; i++) {\n"
+           << "        if (dst->share_hashes[i] >= dst->share_threshold) continue;\n"
+           << "        dst->share_lines[n] = dst->share_lines[i];\n"
+           << "        dst->share_hashes[n] = dst->share_hashes[i];\n"
+           << "        dst->share_reads[n] = dst->share_reads[i];\n"
+           << "        dst->share_writes[n] = dst->share_writes[i];\n"
+           << "        dst->share_flags[n++] = dst->share_flags[i];\n"
+           << "    }\n"
+           << "    dst->share_count = n;\n"
+           << "    dst->share_last = 0;\n"
+           << "    for (i = 0; i < src->share_count; i++) {\n"
+           << "        if (src->share_hashes[i] >= dst->share_threshold) continue;\n"
+           << "        j = __mem_share_slot(dst, src->share_lines[i]);\n"
+           << "        if (j < 0) continue;\n"
+           << "        sr = src->share_reads[i];\n"
+           << "        sw = src->share_writes[i];\n"
+           << "        dr = dst->share_reads[j];\n"
+           << "        dw = dst->share_writes[j];\n"
+           << "        if ((sw & (dr | dw)) || (dw & sr))\n"
+           << "            dst->share_flags[j] |= MEM_SHARED_WRITE;\n"
+           << "        else if ((sw && (dr | dw)) || (dw && sr))\n"
+           << "            dst->share_flags[j] |= MEM_FALSE_SHARING;\n"
+           << "        else if (sr & dr)\n"
+           << "            dst->share_flags[j] |= MEM_SHARED_READ;\n"
+           << "        dst->share_flags[j] |= src->share_flags[i];\n"
+           << "        dst->share_reads[j] = dr | sr;\n"
+           << "        dst->share_writes[j] = dw | sw;\n"
+           << "    }\n"
+           << "}\n"
+           << "#endif\n\n"
+           << "// 把src的访存模式合并进dst：相同步长的计数与误差相加；dst中没有的步长按Space-Saving规则\n"
+           << "// 替换计数最小的表项，被替换的计数计入误差上界；嵌套模式表按同样规则合并。\n"
+           << "// 阶段是各线程自己的时间线，不做合并，保留dst的阶段；各线程并行执行，周期数取最大值\n"
+           << "// 线程间共享只在这里比较，因此只出现在合并后的结果中\n"
+           << "static inline void __mem_merge(mem_profile_t* dst, mem_profile_t* src) {\n"
+           << "    int i, j, victim;\n"
+           << "    __mem_run_close(dst);\n"
+           << "    __mem_run_close(src);\n"
+           << "    for (i = 0; i < MEM_MAX_PATTERNS; i++) {\n"
+           << "        mem_step_t step = src->patterns[i];\n"
+           << "        if (step == MEM_EMPTY_PATTERN) continue;\n"
+           << "        \n"
+           << "        victim = 0;\n"
+           << "        for (j = 0; j < MEM_MAX_PATTERNS; j++) {\n"
+           << "            if (dst->patterns[j] == step) break;\n"
+           << "            if (dst->pattern_counts[j] < dst->pattern_counts[victim])\n"
+           << "                victim = j;\n"
+           << "        }\n"
+           << "        if (j == MEM_MAX_PATTERNS) {\n"
+           << "            j = victim;\n"
+           << "            dst->patterns[j] = step;\n"
+           << "            dst->pattern_errors[j] = dst->pattern_counts[j];\n"
+           << "#if MEM_SAMPLE_PERIOD > 1\n"
+           << "            dst->pattern_exact[j] = 0;\n"
+           << "#endif\n"
+           << "        }\n"
+           << "        __mem_count_add(dst, &dst->pattern_errors[j], src->pattern_errors[i]);\n"
+           << "        __mem_count_add(dst, &dst->pattern_counts[j], src->pattern_counts[i]);\n"
+           << "#if MEM_SAMPLE_PERIOD > 1\n"
+           << "        __mem_add_exact(dst, j, src->pattern_exact[i]);\n"
+           << "#endif\n"
+           << "    }\n"
+           << "    \n"
+           << "    for (i = 0; i < MEM_MAX_NESTED; i++) {\n"
+           << "        if (src->nested_counts[i] == 0) continue;\n"
+           << "        \n"
+           << "        victim = 0;\n"
+           << "        for (j = 0; j < MEM_MAX_NESTED; j++) {\n"
+           << "            if (dst->nested_steps[j] == src->nested_steps[i] && dst->nested_lens[j] == src->nested_lens[i] &&\n"
+           << "                dst->nested_jumps[j] == src->nested_jumps[i]) break;\n"
+           << "            if (dst->nested_counts[j] < dst->nested_counts[victim])\n"
+           << "                victim = j;\n"
+           << "        }\n"
+           << "        if (j == MEM_MAX_NESTED) {\n"
+           << "            j = victim;\n"
+           << "            dst->nested_steps[j] = src->nested_steps[i];\n"
+           << "            dst->nested_lens[j] = src->nested_lens[i];\n"
+           << "            dst->nested_jumps[j] = src->nested_jumps[i];\n"
+           << "        }\n"
+           << "        __mem_count_add(dst, &dst->nested_counts[j], src->nested_counts[i]);\n"
+           << "    }\n"
+           << "    \n"
+           << "    // 访问范围取并集\n"
+           << "    if (src->total_accesses > 0) {\n"
+           << "        if (dst->total_accesses == 0) {\n"
+           << "            dst->base_addr = src->base_addr;\n"
+           << "            dst->end_addr = src->end_addr;\n"
+           << "        } else {\n"
+           << "            dst->base_addr = src->base_addr < dst->base_addr ? src->base_addr : dst->base_addr;\n"
+           << "            dst->end_addr = src->end_addr > dst->end_addr ? src->end_addr : dst->end_addr;\n"
+           << "        }\n"
+           << "    }\n"
+           << "    dst->total_accesses += src->total_accesses;\n"
+           << "    dst->sampled_accesses += src->sampled_accesses;\n"
+           << "#if MEM_SAMPLE_PERIOD > 1\n"
+           << "    dst->exact_accesses += src->exact_accesses;\n"
+           << "#endif\n"
+           << "#if MEM_REUSE_DISTANCE\n"
+           << "    for (i = 0; i <= MEM_REUSE_BINS; i++)\n"
+           << "        dst->reuse_hist[i] += src->reuse_hist[i];\n"
+           << "#endif\n"
+           << "#if MEM_RUN_LENGTHS\n"
+           << "    // 跟踪的步长相同时直方图相加，否则保留覆盖元素更多的一方\n"
+           << "    if (src->run_hist_step == dst->run_hist_step) {\n"
+           << "        for (i = 0; i < MEM_RUN_BINS; i++)\n"
+           << "            dst->run_hist[i] += src->run_hist[i];\n"
+           << "        dst->runs += src->runs;\n"
+           << "        dst->run_total += src->run_total;\n"
+           << "        dst->run_max = src->run_max > dst->run_max ? src->run_max : dst->run_max;\n"
+           << "    } else if (src->run_total > dst->run_total) {\n"
+           << "        dst->run_hist_step = src->run_hist_step;\n"
+           << "        memcpy(dst->run_hist, src->run_hist, sizeof(dst->run_hist));\n"
+           << "        dst->runs = src->runs;\n"
+           << "        dst->run_total = src->run_total;\n"
+           << "        dst->run_max = src->run_max;\n"
+           << "    }\n"
+           << "#endif\n"
+           << "#if MEM_LOAD_STORE\n"
+           << "    for (i = 0; i < 2; i++) {\n"
+           << "        dst->kind_accesses[i] += src->kind_accesses[i];\n"
+           << "        for (j = 0; j < MEM_KIND_PATTERNS; j++) {\n"
+           << "            if (src->kind_counts[i][j] > 0)\n"
+           << "                __mem_kind_step(dst, i, src->kind_steps[i][j], src->kind_counts[i][j]);\n"
+           << "        }\n"
+           << "    }\n"
+           << "#endif\n"
+           << "#if MEM_DIM_STRIDES\n"
+           << "    dst->dims = src->dims > dst->dims ? src->dims : dst->dims;\n"
+           << "    dst->dim_accesses += src->dim_accesses;\n"
+           << "    for (i = 0; i < src->dims; i++) {\n"
+           << "        dst->dim_moves[i] += src->dim_moves[i];\n"
+           << "        for (j = 0; j < MEM_DIM_PATTERNS; j++) {\n"
+           << "            if (src->dim_counts[i][j] > 0)\n"
+           << "                __mem_dim_step(dst, i, src->dim_steps[i][j], src->dim_counts[i][j]);\n"
+           << "        }\n"
+           << "    }\n"
+           << "#endif\n"
+           << "#if MEM_SHARING\n"
+           << "    __mem_share_merge(dst, src);\n"
+           << "#endif\n"
+           << "#if MEM_TIMING\n"
+           << "    dst->cycles = src->cycles > dst->cycles ? src->cycles : dst->cycles;\n"
+           << "    dst->timed_accesses += src->timed_accesses;\n"
+           << "#endif\n"
+           << "#if MEM_HEAT_MAP\n"
+           << "    // src的每个桶整体落入dst中的一个桶，必要时先把dst的桶宽扩展到不小于src\n"
+           << "    for (i = 0; i < MEM_HEAT_BINS; i++) {\n"
+           << "        size_t start = src->heat_base + ((size_t)i << src->heat_shift);\n"
+           << "        if (src->heat[i] == 0) continue;\n"
+           << "        if (dst->heat_shift < src->heat_shift || ((start - dst->heat_base) >> dst->heat_shift) >= MEM_HEAT_BINS)\n"
+           << "            __mem_heat_cover(dst, start, start, src->heat_shift);\n"
+           << "        dst->heat[(start - dst->heat_base) >> dst->heat_shift] += src->heat[i];\n"
+           << "    }\n"
+           << "#endif\n"
+           << "}\n\n"
+           << "// 函数退出时把当前线程的分析结果归约到共享结果中，第MEM_REDUCE_THREADS个到达的线程\n"
+           << "// 在锁外就地分析并输出合并后的结果（不在线程栈上复制整个分析结构体），完成后才重置到达数；\n"
+           << "// 下一次内核调用中先到达的线程等待输出结束\n"
+           << "MEM_API void __mem_reduce(mem_shared_profile_t* shared, mem_profile_t* prof) {\n"
+           << "    int last;\n"
+           << "#if MEM_BATCH_SIZE > 0\n"
+           << "    __mem_flush(prof);\n"
+           << "#endif\n"
+           << "    \n"
+           << "    for (;;) {\n"
+           << "        MEM_LOCK(&shared->lock);\n"
+           << "        if (shared->arrivals < MEM_REDUCE_THREADS) break;\n"
+           << "        MEM_UNLOCK(&shared->lock);\n"
+           << "    }\n"
+           << "    if (shared->arrivals == 0)\n"
+           << "        memcpy(&shared->prof, prof, sizeof(mem_profile_t));\n"
+           << "    else\n"
+           << "        __mem_merge(&shared->prof, prof);\n"
+           << "    shared->prof.merged_threads++;\n"
+           << "    last = ++shared->arrivals == MEM_REDUCE_THREADS;\n"
+           << "    MEM_UNLOCK(&shared->lock);\n"
+           << "    \n"
+           << "    if (last) {\n"
+           << "        __mem_analyze(&shared->prof);\n"
+           << "        __mem_print_analysis(&shared->prof);\n"
+           << "        MEM_LOCK(&shared->lock);\n"
+           << "        shared->arrivals = 0;\n"
+           << "        MEM_UNLOCK(&shared->lock);\n"
+           << "    }\n"
+           << "}\n";
+        return ss.str();
+    }
+
+    // 生成累积模式的插桩点登记与退出时报告函数
+    static std::string generateRegistryFunction()
+    {
+        std::stringstream ss;
+        ss << "// 已登记的插桩点\n"
+           << "static mem_site_t* __mem_sites = 0;\n"
+           << "static volatile int __mem_sites_lock = 0;\n\n"
+           << "// 还有未输出结果的插桩点中下一个要输出的，tid为负时统计全部线程。区分循环时取访问次数\n"
+           << "// 最多的，否则按登记表的顺序\n"
+           << "static inline mem_site_t* __mem_next_site(int tid) {\n"
+           << "    mem_site_t *site, *best = 0;\n"
+           << "    size_t key, best_key = 0;\n"
+           << "    int i, ready;\n"
+           << "    for (site = __mem_sites; site; site = site->next) {\n"
+           << "        key = 0;\n"
+           << "        ready = 0;\n"
+           << "        for (i = 0; i < MEM_NUM_THREADS; i++) {\n"
+           << "            if (!site->ready[i] || (tid >= 0 && i != tid)) continue;\n"
+           << "            ready = 1;\n"
+           << "#if MEM_LOOP_SITES\n"
+           << "            key += site->profs[i].total_accesses;\n"
+           << "#endif\n"
+           << "        }\n"
+           << "        if (ready && (!best || key > best_key)) {\n"
+           << "            best = site;\n"
+           << "            best_key = key;\n"
+           << "        }\n"
+           << "    }\n"
+           << "    return best;\n"
+           << "}\n\n"
+           << "// 程序退出时把每个插桩点各线程的结果合并，分析并输出一次\n"
+           << "static inline void __mem_report_all(void) {\n"
+           << "    mem_profile_t merged;\n"
+           << "    mem_site_t* site;\n"
+           << "    int i, first;\n"
+           << "    while ((site = __mem_next_site(-1)) != 0) {\n"
+           << "        first = 1;\n"
+           << "        for (i = 0; i < MEM_NUM_THREADS; i++) {\n"
+           << "            if (!site->ready[i]) continue;\n"
+           << "#if MEM_BATCH_SIZE > 0\n"
+           << "            __mem_flush(&site->profs[i]);\n"
+           << "#endif\n"
+           << "            if (first)\n"
+           << "                memcpy(&merged, &site->profs[i], sizeof(mem_profile_t));\n"
+           << "            else\n"
+           << "                __mem_merge(&merged, &site->profs[i]);\n"
+           << "            merged.merged_threads++;\n"
+           << "            site->ready[i] = 0;\n"
+           << "            first = 0;\n"
+           << "        }\n"
+           << "        __mem_analyze(&merged);\n"
+           << "        __mem_print_analysis(&merged);\n"
+           << "    }\n"
+           << "}\n\n"
+           << "// 返回当前线程在插桩点site的分析结果。首次使用时初始化并登记，主机端同时注册退出时的报告；\n"
+           << "// 之后每次调用只把上次访问地址重置为本次调用中的变量地址，其余统计跨调用累积\n"
+           << "MEM_API mem_profile_t* __mem_site_enter(mem_site_t* site, const char* var_name, const char* func_name,\n"
+           << "                                       void* addr, size_t type_size) {\n"
+           << "    int tid = __mem_thread_id();\n"
+           << "    mem_profile_t* prof = &site->profs[tid];\n"
+           << "    if (site->ready[tid]) {\n"
+           << "        prof->last_addr = (size_t)addr;\n"
+           << "#if MEM_LOAD_STORE\n"
+           << "        prof->kind_last[MEM_LOAD] = (size_t)addr;\n"
+           << "        prof->kind_last[MEM_STORE] = (size_t)addr;\n"
+           << "#endif\n"
+           << "#if MEM_DIM_STRIDES\n"
+           << "        memset(prof->dim_last, 0, sizeof(prof->dim_last));\n"
+           << "#endif\n"
+           << "        return prof;\n"
+           << "    }\n"
+           << "    \n"
+           << "    __mem_init(prof, var_name, func_name, addr, type_size);\n"
+           << "    site->ready[tid] = 1;\n"
+           << "    if (!site->registered) {\n"
+           << "        MEM_LOCK(&__mem_sites_lock);\n"
+           << "        if (!site->registered) {\n"
+           << "#if MEM_BACKEND != MEM_BACKEND_DEVICE\n"
+           << "            if (!__mem_sites)\n"
+           << "                atexit(__mem_report_all);\n"
+           << "#endif\n"
+           << "            site->next = __mem_sites;\n"
+           << "            __mem_sites = site;\n"
+           << "            site->registered = 1;\n"
+           << "        }\n"
+           << "        MEM_UNLOCK(&__mem_sites_lock);\n"
+           << "    }\n"
+           << "    return prof;\n"
+           << "}\n\n"
+           << "// 分析并输出当前线程在全部插桩点累积的结果，然后清空，供内核退出时调用\n"
+           << "MEM_API void __mem_report(void) {\n"
+           << "    int tid = __mem_thread_id();\n"
+           << "    mem_site_t* site;\n"
+           << "    while ((site = __mem_next_site(tid)) != 0) {\n"
+           << "        __mem_analyze(&site->profs[tid]);\n"
+           << "        __mem_print_analysis(&site->profs[tid]);\n"
+           << "        site->ready[tid] = 0;\n"
+           << "    }\n"
+           << "}\n";
+        return ss.str();
+    }
+
+    // 生成函数计时的入口函数
+    static std::string generateTimingFunction()
     {
-        return generateBaseStructures(includes) + generateInitFunction() + generateRecordFunction() +
-               generateAnalysisFunction();
+        std::stringstream ss;
+        ss << "\n#if MEM_TIMING\n"
+           << "// 函数入口处开始计时\n"
+           << "MEM_API void __mem_region_begin(mem_region_t* region, const char* func_name) {\n"
+           << "    region->func_name = func_name;\n"
+           << "    region->bytes = 0;\n"
+           << "    region->cycles = 0;\n"
+           << "    region->start = MEM_CYCLES();\n"
+           << "}\n\n"
+           << "// 函数退出时停止计时，在分析和输出之前调用，周期数不含报告本身的开销\n"
+           << "MEM_API void __mem_region_end(mem_region_t* region) {\n"
+           << "    region->cycles = MEM_CYCLES() - region->start;\n"
+           << "}\n\n"
+           << "// 把本次调用的周期数计入变量的分析结果，并把变量在本次调用中访问的字节数计入函数\n"
+           << "MEM_API void __mem_time(mem_profile_t* prof, mem_region_t* region) {\n"
+           << "    region->bytes += (prof->total_accesses - prof->timed_accesses) * prof->type_size;\n"
+           << "    prof->timed_accesses = prof->total_accesses;\n"
+           << "    prof->cycles += region->cycles;\n"
+           << "}\n\n"
+           << "// 输出一次函数调用的周期数与每周期访问的字节数\n"
+           << "MEM_API void __mem_print_region(mem_region_t* region) {\n"
+           << "    __mem_printf(\"[Memory Timing] thread %d: %s: cycles=%llu, bytes=%zu, bytes/cycle=%.3f\\n\",\n"
+           << "        __mem_thread_id(), region->func_name, region->cycles, region->bytes,\n"
+           << "        region->cycles > 0 ? (double)region->bytes / region->cycles : 0.0);\n"
+           << "}\n"
+           << "#endif\n";
+        return ss.str();
+    }
+
+    // 生成运行时入口函数（MEM_API）的实现
+    static std::string generateEntryPoints()
+    {
+        return generateInitFunction() + generateRecordFunction() + generateAnalysisFunction() +
+               generateDumpFunction() + generatePrintFunction() + generateReduceFunction() +
+               generateRegistryFunction() + generateTimingFunction();
+    }
+
+    // 生成完整的访存分析器代码，入口函数以 static inline 形式嵌入插桩文件
+    static std::string generateCompleteProfiler(const std::vector<std::string> &includes,
+                                                const ProfilerConfig &config)
+    {
+        return generateBaseStructures(includes, config) +
+               "#ifndef MEM_API\n"
+               "#define MEM_API static inline\n"
+               "#endif\n\n" +
+               generateEntryPoints();
+    }
+
+    // 生成插入插桩文件的分析器代码：使用运行时库时只包含其头文件
+    static std::string generateProfiler(const std::vector<std::string> &includes, const ProfilerConfig &config)
+    {
+        if (config.runtimeLibrary)
+            return "#include \"mem_profiler.h\"\n";
+        return generateCompleteProfiler(includes, config);
+    }
+
+    // 生成单独编译的运行时库的头文件 mem_profiler.h：参数、数据结构与入口函数声明。
+    // 库与插桩代码必须使用相同的配置宏（例如 -DMEM_BATCH_SIZE），否则 mem_profile_t 的布局不一致
+    static std::string generateRuntimeHeader(const ProfilerConfig &config)
+    {
+        std::stringstream ss;
+        ss << "#ifndef MEM_PROFILER_H\n"
+           << "#define MEM_PROFILER_H\n"
+           << "#include <stddef.h>\n\n";
+        ss << generateParameters(config);
+        ss << generateReduction(config);
+        ss << generateReuseDistance(config);
+        ss << generateHeatMap(config);
+        ss << generatePhases(config);
+        ss << generateTiming(config);
+        ss << generateLoadStore(config);
+        ss << generateRunLengths(config);
+        ss << generateDimStrides(config);
+        ss << generateLoopSites(config);
+        ss << generateSharing(config);
+        ss << generateDataStructures();
+        ss << "void __mem_init(mem_profile_t* prof, const char* var_name, const char* func_name, void* addr,\n"
+           << "                size_t type_size);\n"
+           << "void __mem_record(mem_profile_t* prof, void* addr);\n"
+           << "void __mem_record_affine(mem_profile_t* prof, void* first, long stride, long count);\n"
+           << "void __mem_record_kind(mem_profile_t* prof, void* addr, int kind);\n"
+           << "void __mem_record_affine_kind(mem_profile_t* prof, void* first, long stride, long count, int kind);\n"
+           << "void __mem_index(mem_profile_t* prof, int dims, long i0, long i1, long i2, long i3);\n"
+           << "void __mem_index_affine(mem_profile_t* prof, int dims, long i0, long i1, long i2, long i3,\n"
+           << "                        long s0, long s1, long s2, long s3, long count);\n"
+           << "void __mem_analyze(mem_profile_t* prof);\n"
+           << "void __mem_print_analysis(mem_profile_t* prof);\n"
+           << "void __mem_loop(mem_profile_t* prof, unsigned line);\n"
+           << "void __mem_report_profiles(mem_profile_t** profs, int count);\n"
+           << "void __mem_reduce(mem_shared_profile_t* shared, mem_profile_t* prof);\n"
+           << "mem_profile_t* __mem_site_enter(mem_site_t* site, const char* var_name, const char* func_name, void* addr,\n"
+           << "                                size_t type_size);\n"
+           << "void __mem_report(void);\n"
+           << "#if MEM_TIMING\n"
+           << "void __mem_region_begin(mem_region_t* region, const char* func_name);\n"
+           << "void __mem_region_end(mem_region_t* region);\n"
+           << "void __mem_time(mem_profile_t* prof, mem_region_t* region);\n"
+           << "void __mem_print_region(mem_region_t* region);\n"
+           << "#endif\n\n"
+           << "#endif // MEM_PROFILER_H\n";
+        return ss.str();
+    }
+
+    // 生成单独编译的运行时库的实现 mem_profiler.c，入口函数为外部函数，
+    // 线程号分配等平台相关部分只存在于库中
+    static std::string generateRuntimeSource(const ProfilerConfig &config)
+    {
+        std::stringstream ss;
+        ss << "#include <stdio.h>\n"
+           << "#include <string.h>\n"
+           << "#include \"mem_profiler.h\"\n\n";
+        ss << generateBackend(config, false);
+        ss << "#define MEM_API\n\n";
+        ss << generateEntryPoints();
+        return ss.str();
     }
 };
 
@@ -0,0 +1,432 @@
+#include "../include/AffineAnalysis.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/Lex/Lexer.h"
+#include <unordered_set>
+
+namespace {
+
+// 循环的规范形式：迭代变量、初值、终值、比较运算与每次迭代的增量
+struct LoopBounds
+{
+    const clang::VarDecl *iv = nullptr;
+    const clang::Expr *lo = nullptr;
+    const clang::Expr *hi = nullptr;
+    clang::BinaryOperatorKind cmp = clang::BO_LT;
+    int64_t delta = 0;
+};
+
+// 下标关于迭代变量的线性形式 coef*i + offset，offset 为空表示 0
+struct LinearForm
+{
+    int64_t coef = 0;
+    std::string offset;
+};
+
+// 收集循环体中被修改或取地址的变量，以及函数调用和跳转语句
+class LoopEffectCollector : public clang::RecursiveASTVisitor<LoopEffectCollector>
+{
+public:
+    std::unordered_set<const clang::VarDecl *> modified;
+    bool hasCall = false;
+    bool hasJump = false;
+
+    bool VisitBinaryOperator(clang::BinaryOperator *BO)
+    {
+        if (BO->isAssignmentOp())
+            mark(BO->getLHS());
+        return true;
+    }
+
+    bool VisitUnaryOperator(clang::UnaryOperator *UO)
+    {
+        if (UO->isIncrementDecrementOp() || UO->getOpcode() == clang::UO_AddrOf)
+            mark(UO->getSubExpr());
+        return true;
+    }
+
+    bool VisitCallExpr(clang::CallExpr *)
+    {
+        hasCall = true;
+        return true;
+    }
+
+    // 任何跳转都可能改变访问的实际执行次数
+    bool VisitStmt(clang::Stmt *S)
+    {
+        if (llvm::isa<clang::BreakStmt>(S) || llvm::isa<clang::ContinueStmt>(S) || llvm::isa<clang::GotoStmt>(S) ||
+            llvm::isa<clang::IndirectGotoStmt>(S) || llvm::isa<clang::ReturnStmt>(S))
+            hasJump = true;
+        return true;
+    }
+
+private:
+    void mark(const clang::Expr *E)
+    {
+        if (const auto *DRE = llvm::dyn_cast<clang::DeclRefExpr>(E->IgnoreParenImpCasts()))
+            if (const auto *VD = llvm::dyn_cast<clang::VarDecl>(DRE->getDecl()))
+                modified.insert(VD);
+    }
+};
+
+const clang::VarDecl *getRefVar(const clang::Expr *E)
+{
+    if (const auto *DRE = llvm::dyn_cast<clang::DeclRefExpr>(E->IgnoreParenImpCasts()))
+        return llvm::dyn_cast<clang::VarDecl>(DRE->getDecl());
+    return nullptr;
+}
+
+std::string getText(const clang::Expr *E, clang::ASTContext &ctx)
+{
+    clang::CharSourceRange Range = clang::CharSourceRange::getTokenRange(E->getSourceRange());
+    return std::string(clang::Lexer::getSourceText(Range, ctx.getSourceManager(), ctx.getLangOpts()));
+}
+
+bool referencesVar(const clang::Stmt *S, const clang::VarDecl *VD)
+{
+    if (!S)
+        return false;
+    if (const auto *DRE = llvm::dyn_cast<clang::DeclRefExpr>(S))
+        if (DRE->getDecl() == VD)
+            return true;
+    for (const clang::Stmt *Child : S->children()) {
+        if (referencesVar(Child, VD))
+            return true;
+    }
+    return false;
+}
+
+// 表达式可以移到循环之前求值且结果不变：无副作用、不含宏展开，
+// 引用的变量在循环之前声明且不在循环中被修改；引用非局部变量时要求循环体中没有函数调用
+bool isLoopInvariant(const clang::Stmt *S, const clang::ForStmt *FS, const LoopEffectCollector &effects,
+                     clang::ASTContext &ctx)
+{
+    if (!S)
+        return true;
+    if (const auto *E = llvm::dyn_cast<clang::Expr>(S)) {
+        if (E->getBeginLoc().isMacroID() || E->HasSideEffects(ctx))
+            return false;
+    }
+    if (const auto *DRE = llvm::dyn_cast<clang::DeclRefExpr>(S)) {
+        if (const auto *VD = llvm::dyn_cast<clang::VarDecl>(DRE->getDecl())) {
+            if (effects.modified.count(VD) || (!VD->hasLocalStorage() && effects.hasCall))
+                return false;
+            if (!ctx.getSourceManager().isBeforeInTranslationUnit(VD->getLocation(), FS->getBeginLoc()))
+                return false;
+        }
+    }
+    for (const clang::Stmt *Child : S->children()) {
+        if (!isLoopInvariant(Child, FS, effects, ctx))
+            return false;
+    }
+    return true;
+}
+
+std::optional<int64_t> getConstant(const clang::Expr *E, clang::ASTContext &ctx)
+{
+    if (E->isValueDependent() || !E->getType()->isIntegerType())
+        return std::nullopt;
+    if (auto Value = E->getIntegerConstantExpr(ctx))
+        return Value->getExtValue();
+    return std::nullopt;
+}
+
+std::string combineOffsets(const std::string &lhs, const char *op, const std::string &rhs)
+{
+    if (rhs.empty())
+        return lhs;
+    if (lhs.empty())
+        return std::string(op) == "-" ? "-" + rhs : rhs;
+    return "(" + lhs + " " + op + " " + rhs + ")";
+}
+
+// 将下标表达式分解为 coef*i + offset
+bool matchLinear(const clang::Expr *E, const LoopBounds &bounds, const clang::ForStmt *FS,
+                 const LoopEffectCollector &effects, clang::ASTContext &ctx, LinearForm &out)
+{
+    E = E->IgnoreParenImpCasts();
+    if (getRefVar(E) == bounds.iv) {
+        out.coef = 1;
+        out.offset.clear();
+        return true;
+    }
+    if (!referencesVar(E, bounds.iv)) {
+        if (!isLoopInvariant(E, FS, effects, ctx))
+            return false;
+        out.coef = 0;
+        out.offset = "(" + getText(E, ctx) + ")";
+        return true;
+    }
+
+    if (const auto *BO = llvm::dyn_cast<clang::BinaryOperator>(E)) {
+        LinearForm L, R;
+        switch (BO->getOpcode()) {
+        case clang::BO_Add:
+        case clang::BO_Sub: {
+            if (!matchLinear(BO->getLHS(), bounds, FS, effects, ctx, L) ||
+                !matchLinear(BO->getRHS(), bounds, FS, effects, ctx, R))
+                return false;
+            bool isAdd = BO->getOpcode() == clang::BO_Add;
+            out.coef = isAdd ? L.coef + R.coef : L.coef - R.coef;
+            out.offset = combineOffsets(L.offset, isAdd ? "+" : "-", R.offset);
+            return true;
+        }
+        case clang::BO_Mul: {
+            // 乘法中必须有一侧是整型常量
+            const clang::Expr *KE = BO->getLHS();
+            const clang::Expr *VE = BO->getRHS();
+            auto K = getConstant(KE, ctx);
+            if (!K) {
+                std::swap(KE, VE);
+                K = getConstant(KE, ctx);
+            }
+            if (!K || !matchLinear(VE, bounds, FS, effects, ctx, L))
+                return false;
+            out.coef = *K * L.coef;
+            out.offset = L.offset.empty() ? "" : "(" + std::to_string(*K) + " * " + L.offset + ")";
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    if (const auto *UO = llvm::dyn_cast<clang::UnaryOperator>(E)) {
+        if (UO->getOpcode() == clang::UO_Plus)
+            return matchLinear(UO->getSubExpr(), bounds, FS, effects, ctx, out);
+        if (UO->getOpcode() == clang::UO_Minus) {
+            if (!matchLinear(UO->getSubExpr(), bounds, FS, effects, ctx, out))
+                return false;
+            out.coef = -out.coef;
+            out.offset = out.offset.empty() ? "" : "(-" + out.offset + ")";
+            return true;
+        }
+    }
+    return false;
+}
+
+// 识别循环增量：i++、++i、i--、--i、i += s、i -= s、i = i + s
+std::optional<int64_t> matchIncrement(const clang::Expr *Inc, const clang::VarDecl *IV, clang::ASTContext &ctx)
+{
+    if (!Inc)
+        return std::nullopt;
+    Inc = Inc->IgnoreParenImpCasts();
+
+    if (const auto *UO = llvm::dyn_cast<clang::UnaryOperator>(Inc)) {
+        if (UO->isIncrementDecrementOp() && getRefVar(UO->getSubExpr()) == IV)
+            return UO->isIncrementOp() ? 1 : -1;
+        return std::nullopt;
+    }
+
+    const auto *BO = llvm::dyn_cast<clang::BinaryOperator>(Inc);
+    if (!BO || getRefVar(BO->getLHS()) != IV)
+        return std::nullopt;
+
+    if (BO->getOpcode() == clang::BO_AddAssign || BO->getOpcode() == clang::BO_SubAssign) {
+        auto S = getConstant(BO->getRHS(), ctx);
+        if (!S)
+            return std::nullopt;
+        return BO->getOpcode() == clang::BO_AddAssign ? *S : -*S;
+    }
+
+    if (BO->getOpcode() == clang::BO_Assign) {
+        const auto *Rhs = llvm::dyn_cast<clang::BinaryOperator>(BO->getRHS()->IgnoreParenImpCasts());
+        if (!Rhs || getRefVar(Rhs->getLHS()) != IV)
+            return std::nullopt;
+        auto S = getConstant(Rhs->getRHS(), ctx);
+        if (!S)
+            return std::nullopt;
+        if (Rhs->getOpcode() == clang::BO_Add)
+            return *S;
+        if (Rhs->getOpcode() == clang::BO_Sub)
+            return -*S;
+    }
+    return std::nullopt;
+}
+
+bool matchCanonicalLoop(const clang::ForStmt *FS, clang::ASTContext &ctx, LoopBounds &out)
+{
+    // 初始化部分：int i = lo 或 i = lo
+    const clang::Stmt *Init = FS->getInit();
+    if (!Init)
+        return false;
+    if (const auto *DS = llvm::dyn_cast<clang::DeclStmt>(Init)) {
+        if (!DS->isSingleDecl())
+            return false;
+        const auto *VD = llvm::dyn_cast<clang::VarDecl>(DS->getSingleDecl());
+        if (!VD || !VD->hasInit())
+            return false;
+        out.iv = VD;
+        out.lo = VD->getInit();
+    } else if (const auto *BO = llvm::dyn_cast<clang::BinaryOperator>(Init)) {
+        if (BO->getOpcode() != clang::BO_Assign)
+            return false;
+        out.iv = getRefVar(BO->getLHS());
+        out.lo = BO->getRHS();
+    }
+    if (!out.iv || !out.lo || !out.iv->getType()->isIntegerType() || referencesVar(out.lo, out.iv) ||
+        out.lo->getBeginLoc().isMacroID() || out.lo->HasSideEffects(ctx))
+        return false;
+
+    // 条件部分：i op hi 或 hi op i
+    const auto *Cond = llvm::dyn_cast_or_null<clang::BinaryOperator>(FS->getCond() ? FS->getCond()->IgnoreParenImpCasts()
+                                                                                   : nullptr);
+    if (!Cond || !Cond->isComparisonOp())
+        return false;
+    out.cmp = Cond->getOpcode();
+    if (getRefVar(Cond->getLHS()) == out.iv) {
+        out.hi = Cond->getRHS();
+    } else if (getRefVar(Cond->getRHS()) == out.iv) {
+        out.hi = Cond->getLHS();
+        out.cmp = clang::BinaryOperator::reverseComparisonOp(out.cmp);
+    } else {
+        return false;
+    }
+    if (!out.hi->getType()->isIntegerType() || referencesVar(out.hi, out.iv))
+        return false;
+
+    // 增量部分必须与比较方向一致
+    auto Delta = matchIncrement(FS->getInc(), out.iv, ctx);
+    if (!Delta || *Delta == 0)
+        return false;
+    out.delta = *Delta;
+    switch (out.cmp) {
+    case clang::BO_LT:
+    case clang::BO_LE:
+        return out.delta > 0;
+    case clang::BO_GT:
+    case clang::BO_GE:
+        return out.delta < 0;
+    case clang::BO_NE:
+        return out.delta == 1 || out.delta == -1;
+    default:
+        return false;
+    }
+}
+
+std::string buildTripCount(const LoopBounds &bounds, clang::ASTContext &ctx)
+{
+    std::string L = "(long)(" + getText(bounds.lo, ctx) + ")";
+    std::string H = "(long)(" + getText(bounds.hi, ctx) + ")";
+    int64_t D = bounds.delta > 0 ? bounds.delta : -bounds.delta;
+    std::string Div = D == 1 ? "" : " / " + std::to_string(D);
+    std::string Round = D == 1 ? "" : " + " + std::to_string(D - 1);
+
+    // 递减循环交换上下界后与递增循环同样计算
+    const std::string &Upper = bounds.delta > 0 ? H : L;
+    const std::string &Lower = bounds.delta > 0 ? L : H;
+    switch (bounds.cmp) {
+    case clang::BO_LT:
+    case clang::BO_GT:
+    case clang::BO_NE:
+        return "(" + Upper + " > " + Lower + " ? (" + Upper + " - " + Lower + Round + ")" + Div + " : 0)";
+    default:
+        return "(" + Upper + " >= " + Lower + " ? (" + Upper + " - " + Lower + ")" + Div + " + 1 : 0)";
+    }
+}
+
+// 访问必须位于循环体中且每次迭代都会执行：到达循环之前不能经过分支、内层循环或短路运算。
+// 沿祖先语句由内向外查找，LoopParent 为找到的循环的父语句
+bool isUnconditionalInBody(const clang::Expr *E, const std::vector<const clang::Stmt *> &Ancestors,
+                           const clang::ForStmt *&Loop, const clang::Stmt *&LoopParent)
+{
+    const clang::Stmt *Prev = E;
+
+    for (size_t k = 0; k < Ancestors.size(); k++) {
+        const clang::Stmt *S = Ancestors[k];
+        const clang::Stmt *Parent = k + 1 < Ancestors.size() ? Ancestors[k + 1] : nullptr;
+        if (!S) {
+            // 声明中的初始化表达式，声明边界之外必须是所在的 DeclStmt
+            if (!llvm::isa_and_nonnull<clang::DeclStmt>(Parent))
+                return false;
+            continue;
+        }
+
+        if (const auto *FS = llvm::dyn_cast<clang::ForStmt>(S)) {
+            if (FS->getBody() != Prev)
+                return false;
+            Loop = FS;
+            LoopParent = Parent;
+            return true;
+        }
+        if (llvm::isa<clang::WhileStmt>(S) || llvm::isa<clang::DoStmt>(S) || llvm::isa<clang::IfStmt>(S) ||
+            llvm::isa<clang::SwitchStmt>(S) || llvm::isa<clang::AbstractConditionalOperator>(S) ||
+            llvm::isa<clang::StmtExpr>(S))
+            return false;
+        if (const auto *BO = llvm::dyn_cast<clang::BinaryOperator>(S)) {
+            if (BO->isLogicalOp() || BO->getOpcode() == clang::BO_Comma)
+                return false;
+        }
+        Prev = S;
+    }
+    return false;
+}
+
+} // namespace
+
+std::optional<AffineAccess> analyzeAffineAccess(const clang::ArraySubscriptExpr *ASE,
+                                                const std::vector<const clang::Stmt *> &Ancestors,
+                                                clang::ASTContext &ctx)
+{
+    if (!ASE || ASE->getBeginLoc().isMacroID())
+        return std::nullopt;
+
+    const clang::ForStmt *FS = nullptr;
+    const clang::Stmt *LoopParent = nullptr;
+    if (!isUnconditionalInBody(ASE, Ancestors, FS, LoopParent))
+        return std::nullopt;
+
+    // 摘要插入在循环之前，循环必须直接位于复合语句中
+    if (!llvm::isa_and_nonnull<clang::CompoundStmt>(LoopParent))
+        return std::nullopt;
+
+    LoopBounds Bounds;
+    if (!matchCanonicalLoop(FS, ctx, Bounds))
+        return std::nullopt;
+
+    LoopEffectCollector Effects;
+    Effects.TraverseStmt(const_cast<clang::Stmt *>(FS->getBody()));
+    if (Effects.hasJump || Effects.modified.count(Bounds.iv))
+        return std::nullopt;
+    if (!isLoopInvariant(Bounds.hi, FS, Effects, ctx))
+        return std::nullopt;
+
+    // 多维数组沿内层下标找到数组变量，每一维下标加1跨过的元素数为内层各维长度之积
+    std::vector<const clang::Expr *> Subscripts{ASE->getIdx()};
+    std::vector<int64_t> Scales{1};
+    const clang::Expr *Base = ASE->getBase()->IgnoreParenImpCasts();
+    while (const auto *Inner = llvm::dyn_cast<clang::ArraySubscriptExpr>(Base)) {
+        const clang::ConstantArrayType *Row = ctx.getAsConstantArrayType(Inner->getType());
+        if (!Row)
+            return std::nullopt;
+        Subscripts.push_back(Inner->getIdx());
+        Scales.push_back(Scales.back() * static_cast<int64_t>(Row->getSize().getZExtValue()));
+        Base = Inner->getBase()->IgnoreParenImpCasts();
+    }
+
+    // 数组基址本身也必须在循环中保持不变
+    const clang::VarDecl *BaseVar = getRefVar(Base);
+    if (!BaseVar || Effects.modified.count(BaseVar))
+        return std::nullopt;
+
+    AffineAccess Result;
+    Result.loop = FS;
+    Result.tripCount = buildTripCount(Bounds, ctx);
+    for (size_t k = Subscripts.size(); k-- > 0;) {
+        LinearForm Index;
+        if (Subscripts[k]->HasSideEffects(ctx) || !matchLinear(Subscripts[k], Bounds, FS, Effects, ctx, Index))
+            return std::nullopt;
+
+        std::string First = Index.offset.empty() ? "0" : Index.offset;
+        if (Index.coef != 0) {
+            First = "(" + getText(Bounds.lo, ctx) + ")";
+            if (Index.coef != 1)
+                First = std::to_string(Index.coef) + " * " + First;
+            if (!Index.offset.empty())
+                First += " + " + Index.offset;
+        }
+        Result.firstIndices.push_back(First);
+        Result.indexSteps.push_back(Index.coef * Bounds.delta);
+        Result.stride += Index.coef * Bounds.delta * Scales[k];
+    }
+    return Result;
+}
@@ -24,4 +24,206 @@ cl::list<std::string> TargetFunctions(
     cl::desc("Specify target functions to instrument"),
     cl::value_desc("function_name"),
     cl::CommaSeparated,
-    cl::cat(ToolCategory));
\ No newline at end of file
+    cl::cat(ToolCategory));
+
+cl::opt<ProfilerBackend> Backend(
+    "backend",
+    cl::desc("Select the platform the instrumented code runs on"),
+    cl::values(
+        clEnumValN(ProfilerBackend::Device, "mt3000", "MT3000 accelerator with hthread (default)"),
+        clEnumValN(ProfilerBackend::Pthread, "pthread", "Linux host with pthreads"),
+        clEnumValN(ProfilerBackend::OpenMP, "openmp", "Linux host with OpenMP")),
+    cl::init(ProfilerBackend::Device),
+    cl::cat(ToolCategory));
+
+cl::opt<unsigned> SamplePeriod(
+    "sample-period",
+    cl::desc("Analyze only a sample of the accesses in every period of N (1 = record all)"),
+    cl::value_desc("N"),
+    cl::init(1),
+    cl::cat(ToolCategory));
+
+cl::opt<unsigned> SampleBurst(
+    "sample-burst",
+    cl::desc("Number of consecutive accesses analyzed at the start of each sample period"),
+    cl::value_desc("K"),
+    cl::init(1),
+    cl::cat(ToolCategory));
+
+cl::opt<bool> AffineSummary(
+    "affine-summary",
+    cl::desc("Record affine loop accesses with one summary before the loop (default true)"),
+    cl::init(true),
+    cl::cat(ToolCategory));
+
+cl::opt<unsigned> BatchSize(
+    "batch-size",
+    cl::desc("Buffer N addresses per variable and analyze them in bulk (0 = analyze every access)"),
+    cl::value_desc("N"),
+    cl::init(0),
+    cl::cat(ToolCategory));
+
+cl::opt<OutputFormat> ProfileOutputFormat(
+    "output-format",
+    cl::desc("Select how the instrumented program reports its profiles"),
+    cl::values(
+        clEnumValN(OutputFormat::Text, "text", "[Memory Analysis] text report (default)"),
+        clEnumValN(OutputFormat::Binary, "binary", "Compact [Memory Profile] records with exact counts")),
+    cl::init(OutputFormat::Text),
+    cl::cat(ToolCategory));
+
+cl::opt<unsigned> ReduceThreads(
+    "reduce-threads",
+    cl::desc("Merge the profiles of N threads at function exit and print one record (0 = per thread)"),
+    cl::value_desc("N"),
+    cl::init(0),
+    cl::cat(ToolCategory));
+
+cl::opt<bool> ReuseDistance(
+    "reuse-distance",
+    cl::desc("Report a cache-line reuse distance histogram per variable (disables affine summaries)"),
+    cl::init(false),
+    cl::cat(ToolCategory));
+
+cl::opt<bool> HeatMap(
+    "heat-map",
+    cl::desc("Report a bucketed access-count histogram over each variable's address range"),
+    cl::init(false),
+    cl::cat(ToolCategory));
+
+cl::opt<unsigned> PhaseWindow(
+    "phase-window",
+    cl::desc("Snapshot each variable's patterns every N accesses and report the phases they form (0 = off)"),
+    cl::value_desc("N"),
+    cl::init(0),
+    cl::cat(ToolCategory));
+
+cl::opt<bool> Timing(
+    "timing",
+    cl::desc("Time each instrumented function with the cycle counter and report bytes per cycle"),
+    cl::init(false),
+    cl::cat(ToolCategory));
+
+cl::opt<bool> LoadStore(
+    "load-store",
+    cl::desc("Count loads and stores separately, each with its own stride table"),
+    cl::init(false),
+    cl::cat(ToolCategory));
+
+cl::opt<bool> RunLengths(
+    "run-lengths",
+    cl::desc("Add a histogram of contiguous run lengths of the dominant stride to each report"),
+    cl::init(false),
+    cl::cat(ToolCategory));
+
+cl::opt<bool> DimStrides(
+    "dim-strides",
+    cl::desc("Report per-dimension index steps of multi-dimensional arrays and flag loop-interchange opportunities"),
+    cl::init(false),
+    cl::cat(ToolCategory));
+
+cl::opt<bool> LoopSites(
+    "loop-sites",
+    cl::desc("Profile each variable separately in every loop that accesses it and report the hottest loops first"),
+    cl::init(false),
+    cl::cat(ToolCategory));
+
+cl::opt<bool> Sharing(
+    "sharing",
+    cl::desc("Compare the cache lines each thread touches when profiles are merged and report shared and falsely shared lines"),
+    cl::init(false),
+    cl::cat(ToolCategory));
+
+cl::opt<bool> CompactProfile(
+    "compact-profile",
+    cl::desc("Use the compact profile layout: name pointers and 32-bit steps and counters"),
+    cl::init(false),
+    cl::cat(ToolCategory));
+
+cl::opt<bool> Accumulate(
+    "accumulate",
+    cl::desc("Keep profiles in static per-site storage that accumulates across calls and report once at exit"),
+    cl::init(false),
+    cl::cat(ToolCategory));
+
+cl::list<std::string> ReportFunctions(
+    "report-funcs",
+    cl::desc("With -accumulate, print the calling thread's accumulated profiles when these functions return"),
+    cl::value_desc("function_name"),
+    cl::CommaSeparated,
+    cl::cat(ToolCategory));
+
+cl::opt<bool> RuntimeLibrary(
+    "runtime-lib",
+    cl::desc("Include mem_profiler.h and call the separately compiled runtime library instead of inlining the runtime"),
+    cl::init(false),
+    cl::cat(ToolCategory));
+
+cl::opt<std::string> EmitRuntime(
+    "emit-runtime",
+    cl::desc("Write mem_profiler.h and mem_profiler.c for the current options into this directory and exit"),
+    cl::value_desc("directory"),
+    cl::cat(ToolCategory));
+
+cl::opt<unsigned> Jobs(
+    "j",
+    cl::desc("Instrument up to N translation units in parallel (0 = one per hardware thread)"),
+    cl::value_desc("N"),
+    cl::init(1),
+    cl::cat(ToolCategory));
+
+cl::opt<std::string> CacheDir(
+    "cache-dir",
+    cl::desc("Reuse instrumented files from this directory when the preprocessed source and options are unchanged"),
+    cl::value_desc("directory"),
+    cl::cat(ToolCategory));
+
+ProfilerConfig getProfilerConfig()
+{
+    ProfilerConfig config;
+    config.backend = Backend;
+    config.samplePeriod = SamplePeriod;
+    config.sampleBurst = SampleBurst;
+    config.affineSummary = AffineSummary;
+    config.batchSize = BatchSize;
+    config.outputFormat = ProfileOutputFormat;
+    config.reduceThreads = ReduceThreads;
+    config.reuseDistance = ReuseDistance;
+    config.heatMap = HeatMap;
+    config.phaseWindow = PhaseWindow;
+    config.timing = Timing;
+    config.loadStore = LoadStore;
+    config.runLengths = RunLengths;
+    config.dimStrides = DimStrides;
+    config.loopSites = LoopSites;
+    config.sharing = Sharing;
+    config.runtimeLibrary = RuntimeLibrary;
+    config.accumulate = Accumulate;
+    config.compactProfile = CompactProfile;
+    config.reportFunctions.assign(ReportFunctions.begin(), ReportFunctions.end());
+    return config;
+}
+
+std::string getOptionsFingerprint()
+{
+    ProfilerConfig config = getProfilerConfig();
+    std::string fingerprint;
+    llvm::raw_string_ostream os(fingerprint);
+    os << "backend=" << static_cast<int>(config.backend) << ";sample=" << config.samplePeriod << "/"
+       << config.sampleBurst << ";affine=" << config.affineSummary << ";batch=" << config.batchSize
+       << ";output=" << static_cast<int>(config.outputFormat) << ";reduce=" << config.reduceThreads
+       << ";reuse=" << config.reuseDistance << ";heat=" << config.heatMap
+       << ";phase=" << config.phaseWindow << ";timing=" << config.timing
+       << ";ls=" << config.loadStore << ";runs=" << config.runLengths << ";dims=" << config.dimStrides
+       << ";loops=" << config.loopSites << ";sharing=" << config.sharing << ";lib=" << config.runtimeLibrary
+       << ";accumulate=" << config.accumulate
+       << ";compact=" << config.compactProfile << ";report=";
+    for (const auto &func : config.reportFunctions) {
+        os << func << ",";
+    }
+    os << ";targets=";
+    for (const auto &func : TargetFunctions) {
+        os << func << ",";
+    }
+    return os.str();
+}
@@ -9,25 +9,40 @@
 
 #include <MemoryInstrumentation.h>
 
-#include "../include/CommandLineOptions.h"
 #include "../include/MemoryInstrumentation.h"
 
+std::string getInstrumentedFilename(llvm::StringRef inputFullPath, llvm::StringRef outputFilename) {
+    if (!outputFilename.empty()) {
+        // 如果用户通过-o选项指定了输出文件名，直接使用
+        return outputFilename.str();
+    }
+
+    // 分别获取目录路径和文件名
+    llvm::SmallString<128> directory(llvm::sys::path::parent_path(inputFullPath));
+    llvm::StringRef filename = llvm::sys::path::filename(inputFullPath);
+    
+    std::string prefix =  "mem_prof_";
+    
+    // 组合目录路径、前缀和文件名，构造完整的输出路径
+    llvm::SmallString<128> outputPath(directory);
+    llvm::sys::path::append(outputPath, prefix + filename.str());
+    
+    return outputPath.str().str();
+}
+
 std::unique_ptr<clang::ASTConsumer> InstrumentationFrontendAction::CreateASTConsumer(
         clang::CompilerInstance &CI, llvm::StringRef file) {
     rewriter.setSourceMgr(CI.getSourceManager(), CI.getLangOpts());
 
-    // 获取目标函数列表
-    std::vector<std::string> targetFuncs(TargetFunctions.begin(), TargetFunctions.end());
-
     // 如果指定了目标函数，打印相关信息
     if (!targetFuncs.empty()) {
-        llvm::outs() << "Target functions for instrumentation:\n";
+        out << "Target functions for instrumentation:\n";
         for (const auto& func : targetFuncs) {
-            llvm::outs() << "  - " << func << "\n";
+            out << "  - " << func << "\n";
         }
     }
     
-    return std::make_unique<MemoryInstrumentationConsumer>(rewriter, includes, targetFuncs);
+    return std::make_unique<MemoryInstrumentationConsumer>(rewriter, includes, targetFuncs, config, out);
 }
 
 bool InstrumentationFrontendAction::BeginSourceFileAction(clang::CompilerInstance &CI) {
@@ -39,28 +54,18 @@ bool InstrumentationFrontendAction::BeginSourceFileAction(clang::CompilerInstanc
 void InstrumentationFrontendAction::EndSourceFileAction() {
     // 获取主文件ID
     const auto &ID = rewriter.getSourceMgr().getMainFileID();
-    std::string outputName;
 
-    if (!OutputFilename.empty()) {
-        // 如果用户通过-o选项指定了输出文件名，直接使用
-        outputName = OutputFilename;
-    } else {
-        // 获取输入文件的完整路径
-        llvm::StringRef inputFullPath = rewriter.getSourceMgr().getFilename(
-            rewriter.getSourceMgr().getLocForStartOfFile(ID));
-        
-        // 分别获取目录路径和文件名
-        llvm::SmallString<128> directory(llvm::sys::path::parent_path(inputFullPath));
-        llvm::StringRef filename = llvm::sys::path::filename(inputFullPath);
-        
-        std::string prefix =  "mem_prof_";
-        
-        // 组合目录路径、前缀和文件名，构造完整的输出路径
-        llvm::SmallString<128> outputPath(directory);
-        llvm::sys::path::append(outputPath, prefix + filename.str());
-        
-        outputName = outputPath.str().str();
+    // 获取重写后的代码缓冲区
+    const llvm::RewriteBuffer *RewriteBuf = rewriter.getRewriteBufferFor(ID);
+    if (!RewriteBuf) {
+        err << "Error: No rewrite buffer for main file\n";
+        return;
     }
+    emitInstrumentedSource(getCurrentFile(), std::string(RewriteBuf->begin(), RewriteBuf->end()));
+}
+
+void InstrumentationFrontendAction::emitInstrumentedSource(llvm::StringRef inputFile, llvm::StringRef code) {
+    std::string outputName = getInstrumentedFilename(inputFile, outputFilename);
 
     // 创建输出文件
     std::error_code EC;
@@ -68,18 +73,12 @@ void InstrumentationFrontendAction::EndSourceFileAction() {
 
     // 检查文件创建是否成功
     if (EC) {
-        llvm::errs() << "Error: Could not create output file " << outputName 
-                     << ": " << EC.message() << "\n";
+        err << "Error: Could not create output file " << outputName 
+            << ": " << EC.message() << "\n";
         return;
     }
 
-    // 获取重写后的代码缓冲区
-    const llvm::RewriteBuffer *RewriteBuf = rewriter.getRewriteBufferFor(ID);
-    if (RewriteBuf) {
-        // 将重写后的代码写入文件
-        outFile << std::string(RewriteBuf->begin(), RewriteBuf->end());
-        llvm::outs() << "Successfully generated instrumented file: " << outputName << "\n";
-    } else {
-        llvm::errs() << "Error: No rewrite buffer for main file\n";
-    }
+    // 将重写后的代码写入文件
+    outFile << code;
+    out << "Successfully generated instrumented file: " << outputName << "\n";
 }
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include "../include/InstrumentationCache.h"
+#include "../include/CommandLineOptions.h"
+#include "../include/FrontendAction.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/SHA256.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include <functional>
+
+namespace {
+
+// 只做预处理：把主文件原文和宏展开后的全部词法单元计入散列
+class HashPreprocessedAction : public clang::PreprocessorFrontendAction
+{
+public:
+    HashPreprocessedAction(llvm::SHA256 &hasher, std::string &outputName)
+        : hasher(hasher), outputName(outputName) {}
+
+protected:
+    void ExecuteAction() override
+    {
+        clang::Preprocessor &PP = getCompilerInstance().getPreprocessor();
+        clang::SourceManager &SM = PP.getSourceManager();
+        clang::FileID MainFileID = SM.getMainFileID();
+
+        // 插桩直接改写主文件原文，注释和宏的写法变化也要使缓存失效
+        hasher.update(SM.getBufferData(MainFileID));
+        outputName = getInstrumentedFilename(SM.getFilename(SM.getLocForStartOfFile(MainFileID)), OutputFilename);
+
+        PP.EnterMainSourceFile();
+        clang::Token Tok;
+        do {
+            PP.Lex(Tok);
+            hasher.update(PP.getSpelling(Tok));
+            hasher.update(llvm::StringRef(" ", 1));
+        } while (Tok.isNot(clang::tok::eof));
+    }
+
+private:
+    llvm::SHA256 &hasher;
+    std::string &outputName;
+};
+
+class HashPreprocessedActionFactory : public clang::tooling::FrontendActionFactory
+{
+public:
+    HashPreprocessedActionFactory(llvm::SHA256 &hasher, std::string &outputName)
+        : hasher(hasher), outputName(outputName) {}
+
+    std::unique_ptr<clang::FrontendAction> create() override
+    {
+        return std::make_unique<HashPreprocessedAction>(hasher, outputName);
+    }
+
+private:
+    llvm::SHA256 &hasher;
+    std::string &outputName;
+};
+
+} // namespace
+
+InstrumentationCache::InstrumentationCache(std::string directory, const char *argv0)
+    : directory(std::move(directory))
+{
+    std::string executable = llvm::sys::fs::getMainExecutable(argv0, (void *)&getOptionsFingerprint);
+    llvm::sys::fs::file_status status;
+    toolIdentity = executable;
+    if (!llvm::sys::fs::status(executable, status)) {
+        toolIdentity += ";" + std::to_string(status.getSize()) + ";" +
+                        std::to_string(llvm::sys::toTimeT(status.getLastModificationTime()));
+    }
+}
+
+std::string InstrumentationCache::entryPath(const std::string &key) const
+{
+    llvm::SmallString<256> path(directory);
+    llvm::sys::path::append(path, key + ".c");
+    return path.str().str();
+}
+
+bool InstrumentationCache::lookup(const clang::tooling::CompilationDatabase &compilations, const std::string &file,
+                                  CacheEntry &entry, llvm::raw_ostream &out) const
+{
+    llvm::SHA256 hasher;
+    hasher.update(toolIdentity);
+    hasher.update(getOptionsFingerprint());
+    for (const auto &command : compilations.getCompileCommands(file)) {
+        for (const auto &arg : command.CommandLine) {
+            hasher.update(arg);
+            hasher.update(llvm::StringRef("\0", 1));
+        }
+    }
+
+    // 预处理错误交给随后的完整插桩报告，这里只判断能否缓存
+    clang::tooling::ClangTool Tool(compilations, {file}, std::make_shared<clang::PCHContainerOperations>(),
+                                   llvm::vfs::createPhysicalFileSystem());
+    clang::IgnoringDiagConsumer Diagnostics;
+    Tool.setDiagnosticConsumer(&Diagnostics);
+    HashPreprocessedActionFactory Factory(hasher, entry.outputName);
+    if (Tool.run(&Factory) != 0) {
+        entry.key.clear();
+        return false;
+    }
+    entry.key = llvm::toHex(hasher.final(), /*LowerCase=*/true);
+
+    std::string cached = entryPath(entry.key);
+    if (!llvm::sys::fs::exists(cached) || llvm::sys::fs::copy_file(cached, entry.outputName)) {
+        // 删除旧的输出，避免插桩失败时把上一次的结果存入缓存
+        llvm::sys::fs::remove(entry.outputName);
+        return false;
+    }
+    out << "Reused cached instrumented file: " << entry.outputName << "\n";
+    return true;
+}
+
+void InstrumentationCache::store(const CacheEntry &entry, llvm::raw_ostream &err) const
+{
+    if (entry.key.empty() || !llvm::sys::fs::exists(entry.outputName))
+        return;
+
+    // 先写入临时文件再改名，并行插桩或多个构建同时写入时不会读到不完整的缓存项
+    std::string cached = entryPath(entry.key);
+    std::string temporary = cached + ".tmp" + std::to_string(llvm::sys::Process::getProcessId()) + "." +
+                            std::to_string(std::hash<std::string>()(entry.outputName));
+    std::error_code EC = llvm::sys::fs::create_directories(directory);
+    if (!EC)
+        EC = llvm::sys::fs::copy_file(entry.outputName, temporary);
+    if (!EC)
+        EC = llvm::sys::fs::rename(temporary, cached);
+    if (EC) {
+        llvm::sys::fs::remove(temporary);
+        err << "Warning: could not write cache entry " << cached << ": " << EC.message() << "\n";
+    }
+}
@@ -0,0 +1,229 @@
+// InstrumentationPlugin.cpp
+// 以 clang 插件的形式在真正的编译过程中插桩：改写后的主文件作为内存缓冲区重新映射，
+// 直接交给原编译调用生成编译产物，不写出 mem_prof_<文件名> 中间文件。
+//
+//   clang -fplugin=bin/MemProfMT.so -fplugin-arg-memprof-backend=pthread -c kernel.c -o kernel.o
+//
+// 插件参数与命令行工具的选项同名：backend、target-funcs、sample-period、sample-burst、
+// affine-summary、batch-size、output-format、reduce-threads、reuse-distance、heat-map、phase-window、
+// timing、load-store、run-lengths、dim-strides、loop-sites、sharing、compact-profile、accumulate、
+// report-funcs、runtime-lib。
+//
+// 编译产物与驱动程序的要求一致（-c、-S、-emit-llvm）。插件替换动作后前端不一定保留原动作，此时按 -o 的
+// 扩展名（.o、.s、.ll、.bc）判断，无法判断时生成目标文件；emit=obj|asm|llvm|bc 可以显式指定产物，
+// 与驱动程序要求的产物不一致时报错。
+#include "../include/FrontendAction.h"
+#include "clang/CodeGen/CodeGenAction.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendPluginRegistry.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include <optional>
+
+namespace {
+
+class InstrumentationPluginAction : public InstrumentationFrontendAction
+{
+public:
+    // 编译过程中不输出进度信息，错误仍写到标准错误
+    InstrumentationPluginAction()
+        : InstrumentationFrontendAction(ProfilerConfig(), {}, "", llvm::nulls(), llvm::errs()) {}
+
+    // 替换驱动程序原本的编译动作，插桩完成后由本动作负责生成编译产物
+    ActionType getActionType() override { return ReplaceAction; }
+
+    bool ParseArgs(const clang::CompilerInstance &CI, const std::vector<std::string> &args) override;
+
+protected:
+    void emitInstrumentedSource(llvm::StringRef inputFile, llvm::StringRef code) override;
+
+private:
+    enum class EmitKind { Object, Assembly, LLVMIR, Bitcode };
+    EmitKind emit = EmitKind::Object;
+
+    // 驱动程序要求的编译产物，无法判断时为空
+    static std::optional<EmitKind> getRequestedKind(const clang::FrontendOptions &Opts);
+};
+
+std::optional<InstrumentationPluginAction::EmitKind>
+InstrumentationPluginAction::getRequestedKind(const clang::FrontendOptions &Opts)
+{
+    switch (Opts.ProgramAction) {
+    case clang::frontend::EmitObj:
+        return EmitKind::Object;
+    case clang::frontend::EmitAssembly:
+        return EmitKind::Assembly;
+    case clang::frontend::EmitLLVM:
+        return EmitKind::LLVMIR;
+    case clang::frontend::EmitBC:
+        return EmitKind::Bitcode;
+    default:
+        break;
+    }
+
+    // 加载替换动作的插件时前端把原动作改成了 PluginAction，驱动程序总会传入 -o，按扩展名判断
+    return llvm::StringSwitch<std::optional<EmitKind>>(llvm::sys::path::extension(Opts.OutputFile))
+        .Cases(".o", ".obj", EmitKind::Object)
+        .Case(".s", EmitKind::Assembly)
+        .Case(".ll", EmitKind::LLVMIR)
+        .Case(".bc", EmitKind::Bitcode)
+        .Default(std::nullopt);
+}
+
+bool parseUnsigned(llvm::StringRef value, unsigned &result)
+{
+    return !value.getAsInteger(10, result);
+}
+
+bool InstrumentationPluginAction::ParseArgs(const clang::CompilerInstance &CI, const std::vector<std::string> &args)
+{
+    clang::DiagnosticsEngine &Diags = CI.getDiagnostics();
+    unsigned InvalidArg =
+        Diags.getCustomDiagID(clang::DiagnosticsEngine::Error, "invalid memprof plugin argument '%0'");
+    std::optional<EmitKind> requested = getRequestedKind(CI.getFrontendOpts());
+    emit = requested.value_or(EmitKind::Object);
+
+    for (const auto &arg : args) {
+        auto [key, value] = llvm::StringRef(arg).split('=');
+        bool valid = true;
+        if (key == "backend") {
+            auto backend = llvm::StringSwitch<std::optional<ProfilerBackend>>(value)
+                               .Case("mt3000", ProfilerBackend::Device)
+                               .Case("pthread", ProfilerBackend::Pthread)
+                               .Case("openmp", ProfilerBackend::OpenMP)
+                               .Default(std::nullopt);
+            valid = backend.has_value();
+            if (valid)
+                config.backend = *backend;
+        } else if (key == "target-funcs") {
+            llvm::SmallVector<llvm::StringRef, 8> funcs;
+            value.split(funcs, ',', -1, false);
+            for (auto func : funcs)
+                targetFuncs.push_back(func.str());
+        } else if (key == "sample-period") {
+            valid = parseUnsigned(value, config.samplePeriod);
+        } else if (key == "sample-burst") {
+            valid = parseUnsigned(value, config.sampleBurst);
+        } else if (key == "affine-summary") {
+            valid = value == "true" || value == "false";
+            config.affineSummary = value == "true";
+        } else if (key == "batch-size") {
+            valid = parseUnsigned(value, config.batchSize);
+        } else if (key == "output-format") {
+            valid = value == "text" || value == "binary";
+            config.outputFormat = value == "binary" ? OutputFormat::Binary : OutputFormat::Text;
+        } else if (key == "reduce-threads") {
+            valid = parseUnsigned(value, config.reduceThreads);
+        } else if (key == "reuse-distance") {
+            valid = value.empty() || value == "true" || value == "false";
+            config.reuseDistance = value != "false";
+        } else if (key == "heat-map") {
+            valid = value.empty() || value == "true" || value == "false";
+            config.heatMap = value != "false";
+        } else if (key == "timing") {
+            valid = value.empty() || value == "true" || value == "false";
+            config.timing = value != "false";
+        } else if (key == "load-store") {
+            valid = value.empty() || value == "true" || value == "false";
+            config.loadStore = value != "false";
+        } else if (key == "run-lengths") {
+            valid = value.empty() || value == "true" || value == "false";
+            config.runLengths = value != "false";
+        } else if (key == "dim-strides") {
+            valid = value.empty() || value == "true" || value == "false";
+            config.dimStrides = value != "false";
+        } else if (key == "loop-sites") {
+            valid = value.empty() || value == "true" || value == "false";
+            config.loopSites = value != "false";
+        } else if (key == "sharing") {
+            valid = value.empty() || value == "true" || value == "false";
+            config.sharing = value != "false";
+        } else if (key == "phase-window") {
+            valid = parseUnsigned(value, config.phaseWindow);
+        } else if (key == "compact-profile") {
+            valid = value.empty() || value == "true" || value == "false";
+            config.compactProfile = value != "false";
+        } else if (key == "accumulate") {
+            valid = value.empty() || value == "true" || value == "false";
+            config.accumulate = value != "false";
+        } else if (key == "report-funcs") {
+            llvm::SmallVector<llvm::StringRef, 8> funcs;
+            value.split(funcs, ',', -1, false);
+            for (auto func : funcs)
+                config.reportFunctions.push_back(func.str());
+        } else if (key == "runtime-lib") {
+            valid = value.empty() || value == "true" || value == "false";
+            config.runtimeLibrary = value != "false";
+        } else if (key == "emit") {
+            auto kind = llvm::StringSwitch<std::optional<EmitKind>>(value)
+                            .Case("obj", EmitKind::Object)
+                            .Case("asm", EmitKind::Assembly)
+                            .Case("llvm", EmitKind::LLVMIR)
+                            .Case("bc", EmitKind::Bitcode)
+                            .Default(std::nullopt);
+            valid = kind.has_value();
+            if (valid && requested && *kind != *requested) {
+                unsigned Mismatch = Diags.getCustomDiagID(
+                    clang::DiagnosticsEngine::Error,
+                    "memprof plugin argument '%0' does not match the compiler output '%1'");
+                Diags.Report(Mismatch) << arg << CI.getFrontendOpts().OutputFile;
+                return false;
+            }
+            if (valid)
+                emit = *kind;
+        } else {
+            valid = false;
+        }
+
+        if (!valid) {
+            Diags.Report(InvalidArg) << arg;
+            return false;
+        }
+    }
+    return true;
+}
+
+void InstrumentationPluginAction::emitInstrumentedSource(llvm::StringRef inputFile, llvm::StringRef code)
+{
+    clang::CompilerInstance &CI = getCompilerInstance();
+    if (CI.getDiagnostics().hasErrorOccurred())
+        return;
+
+    // 复制原编译调用，主文件映射为改写后的缓冲区，其余选项（包括 -o）保持不变
+    auto Invocation = std::make_shared<clang::CompilerInvocation>(CI.getInvocation());
+    Invocation->getPreprocessorOpts().addRemappedFile(
+        inputFile, llvm::MemoryBuffer::getMemBufferCopy(code, inputFile).release());
+
+    clang::CompilerInstance Compiler(CI.getPCHContainerOperations());
+    Compiler.setInvocation(std::move(Invocation));
+    // 诊断交给原编译的诊断消费者，改写后代码中的错误同样使本次编译失败
+    Compiler.createDiagnostics(&CI.getDiagnosticClient(), /*ShouldOwnClient=*/false);
+
+    std::unique_ptr<clang::FrontendAction> Action;
+    switch (emit) {
+    case EmitKind::Object:
+        Action = std::make_unique<clang::EmitObjAction>();
+        break;
+    case EmitKind::Assembly:
+        Action = std::make_unique<clang::EmitAssemblyAction>();
+        break;
+    case EmitKind::LLVMIR:
+        Action = std::make_unique<clang::EmitLLVMAction>();
+        break;
+    case EmitKind::Bitcode:
+        Action = std::make_unique<clang::EmitBCAction>();
+        break;
+    }
+
+    if (!Compiler.ExecuteAction(*Action)) {
+        unsigned CompileFailed = CI.getDiagnostics().getCustomDiagID(
+            clang::DiagnosticsEngine::Error, "failed to compile the instrumented source of '%0'");
+        CI.getDiagnostics().Report(CompileFailed) << inputFile;
+    }
+}
+
+} // namespace
+
+static clang::FrontendPluginRegistry::Add<InstrumentationPluginAction>
+    X("memprof", "instrument memory accesses and compile the rewritten source");
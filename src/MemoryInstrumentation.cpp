@@ -5,7 +5,10 @@
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/AST/Stmt.h"
 #include "clang/AST/ASTTypeTraits.h"
+#include <algorithm>
 #include <functional>
+#include <map>
+#include <set>
 #include <sstream>
 #include <string>
 
@@ -19,7 +22,7 @@
 
 bool MemoryInstrumentationVisitor::VisitTranslationUnitDecl(clang::TranslationUnitDecl *TU)
 {
-    llvm::outs() << "Finding appropriate location to insert memory profiler definitions\n";
+    log << "Finding appropriate location to insert memory profiler definitions\n";
 
     const clang::SourceManager &SM = rewriter.getSourceMgr();
     clang::FileID MainFileID = SM.getMainFileID();
@@ -61,17 +64,52 @@ bool MemoryInstrumentationVisitor::VisitTranslationUnitDecl(clang::TranslationUn
         clang::SourceLocation InsertLoc = SM.getLocForStartOfFile(MainFileID).getLocWithOffset(LastPreprocessorLine);
 
         // 添加额外的换行以保持代码整洁
-        std::string Code = "\n" + MemoryCodeGenerator::generateCompleteProfiler(includes) + "\n";
+        std::string Code = "\n" + MemoryCodeGenerator::generateProfiler(includes, config) + "\n";
         rewriter.InsertText(InsertLoc, Code, true, true);
     } else {
         // 如果没有找到预处理指令，则在文件开头插入
         clang::SourceLocation InsertLoc = SM.getLocForStartOfFile(MainFileID);
-        rewriter.InsertText(InsertLoc, MemoryCodeGenerator::generateCompleteProfiler(includes), true, true);
+        rewriter.InsertText(InsertLoc, MemoryCodeGenerator::generateProfiler(includes, config), true, true);
     }
 
     return true;
 }
 
+// 变量作为数组使用时的维数：数组的每一层各算一维，指针（包括退化为指向数组的指针的数组参数）
+// 本身算一维；既不是数组也不是指针时为1
+static unsigned getArrayDims(clang::QualType Type)
+{
+    if (const auto *PT = Type->getAs<clang::PointerType>())
+        Type = PT->getPointeeType();
+    else if (const auto *AT = Type->getAsArrayTypeUnsafe())
+        Type = AT->getElementType();
+    else
+        return 1;
+
+    unsigned Dims = 1;
+    while (const auto *AT = Type->getAsArrayTypeUnsafe()) {
+        Type = AT->getElementType();
+        Dims++;
+    }
+    return Dims;
+}
+
+// 多维数组访问 a[i][j]：沿结果仍为数组的内层下标找到数组变量，Indices 中按维由外向内
+// 存放各维下标。指针数组 p[i][j] 的内层下标结果是指针，不属于同一数组，此时返回空
+static const clang::DeclRefExpr *getSubscriptBase(const clang::ArraySubscriptExpr *ASE,
+                                                   std::vector<const clang::Expr *> &Indices)
+{
+    Indices.assign(1, ASE->getIdx());
+    const clang::Expr *Base = ASE->getBase()->IgnoreImplicit();
+    while (const auto *Inner = llvm::dyn_cast<clang::ArraySubscriptExpr>(Base)) {
+        if (!Inner->getType()->isArrayType())
+            return nullptr;
+        Indices.insert(Indices.begin(), Inner->getIdx());
+        Base = Inner->getBase()->IgnoreImplicit();
+    }
+    return llvm::dyn_cast<clang::DeclRefExpr>(Base);
+}
+
 void MemoryInstrumentationVisitor::insertVarProfiler(const clang::VarDecl *VD)
 {
     if (!shouldInstrumentVar(VD))
@@ -99,9 +137,8 @@ void MemoryInstrumentationVisitor::insertVarProfiler(const clang::VarDecl *VD)
     clang::QualType type = VD->getType();
     std::string addrExpr = (type->isArrayType() || type->isPointerType()) ? VarName : "&" + VarName;
 
-    SS << "\nmem_profile_t __" << VarName << "_prof;\n"
-       << "__mem_init(&__" << VarName << "_prof, \"" << VarName << "\", \"" << FuncName << "\", (void*)" << addrExpr
-       << ", sizeof(" << VarName << "[0]));\n";
+    SS << generateInitCode(VarName, FuncName, addrExpr, getArrayDims(type), "");
+    SS << generateLoopInitCode(VarName, FuncName, addrExpr, getArrayDims(type), "");
 
     // 获取变量声明后的正确位置
     clang::SourceLocation InsertLoc;
@@ -137,9 +174,9 @@ void MemoryInstrumentationVisitor::insertFuncParamProfiler(const clang::Function
             clang::QualType type = Param->getType();
             std::string addrExpr = (type->isArrayType() || type->isPointerType()) ? ParamName : "&" + ParamName;
 
-            ParamProfilerCode += "\n\tmem_profile_t __" + ParamName + "_prof;\n" + "\t__mem_init(&__" + ParamName +
-                                 "_prof, \"" + ParamName + "\", \"" + FD->getNameAsString() + "\", (void*)" + addrExpr +
-                                 ", sizeof(" + ParamName + "[0]));\n";
+            ParamProfilerCode += generateInitCode(ParamName, FD->getNameAsString(), addrExpr, getArrayDims(type), "\t");
+            ParamProfilerCode +=
+                generateLoopInitCode(ParamName, FD->getNameAsString(), addrExpr, getArrayDims(type), "\t");
             instrumentedVars.insert(ParamName);
             functionVars[FD->getNameAsString()].push_back(ParamName);
         }
@@ -180,7 +217,7 @@ bool MemoryInstrumentationVisitor::insertAccessProfiler(const clang::Expr *E) co
     if (VarName.empty() || !instrumentedVars.count(VarName) || !isInMainFile(InsertLoc))
         return true;
 
-    std::string RecordCode = "__mem_record(&__" + VarName + "_prof, (void*)&(" + AccessExpr + "));\n";
+    std::string RecordCode = generateRecordCall(ME, VarName, AccessExpr) + "\n";
     rewriter.InsertText(InsertLoc, RecordCode, true, true);
     return true;
 }
@@ -199,13 +236,95 @@ void MemoryInstrumentationVisitor::insertAnalysisCode(clang::ReturnStmt *RS)
     rewriter.InsertText(Loc, analysisCode, true, true);
 }
 
+std::string MemoryInstrumentationVisitor::generateInitCode(const std::string &VarName, const std::string &FuncName,
+                                                           const std::string &AddrExpr, unsigned Dims,
+                                                           const std::string &Indent, const LoopSite *Site) const
+{
+    // 多维数组以最内层的元素为单位，步长与元素数不受行长度影响
+    std::string Element = VarName;
+    for (unsigned i = 0; i < Dims; i++)
+        Element += "[0]";
+    std::string Args = "\"" + VarName + "\", \"" + FuncName + "\", (void*)" + AddrExpr + ", sizeof(" + Element + ")";
+    std::string ProfVar = Site ? VarName + "_loop" + std::to_string(Site->id) : VarName;
+    std::string Code;
+    if (config.accumulate) {
+        // 每个插桩点一份静态存储，结果跨调用累积
+        Code = "\n" + Indent + "static mem_site_t __" + ProfVar + "_site;\n" + Indent + "mem_profile_t* __" + ProfVar +
+               "_prof = __mem_site_enter(&__" + ProfVar + "_site, " + Args + ");\n";
+    } else {
+        Code = "\n" + Indent + "mem_profile_t __" + ProfVar + "_prof;\n" + Indent + "__mem_init(&__" + ProfVar +
+               "_prof, " + Args + ");\n";
+    }
+    if (Site)
+        Code += Indent + "__mem_loop(" + getProfileRef(ProfVar) + ", " + std::to_string(Site->line) + ");\n";
+    return Code;
+}
+
+std::string MemoryInstrumentationVisitor::generateLoopInitCode(const std::string &VarName, const std::string &FuncName,
+                                                               const std::string &AddrExpr, unsigned Dims,
+                                                               const std::string &Indent)
+{
+    auto It = loopSites.find(VarName);
+    if (!config.loopSites || It == loopSites.end())
+        return "";
+
+    std::string Code;
+    for (const auto &Site : It->second) {
+        std::string ProfVar = VarName + "_loop" + std::to_string(Site.id);
+        Code += generateInitCode(VarName, FuncName, AddrExpr, Dims, Indent, &Site);
+        instrumentedVars.insert(ProfVar);
+        functionInitializedVars[FuncName].insert(ProfVar);
+    }
+    return Code;
+}
+
+std::string MemoryInstrumentationVisitor::getProfileRef(const std::string &VarName) const
+{
+    // 累积模式下 __<var>_prof 本身就是指向静态存储的指针
+    return (config.accumulate ? "__" : "&__") + VarName + "_prof";
+}
+
 std::string MemoryInstrumentationVisitor::generateAnalysisCode(const std::string &functionName)
 {
     std::stringstream analysisCode;
 
+    // 先停止计时，再把周期数分给函数中的各变量，分析与输出本身不计入
+    if (config.timing) {
+        analysisCode << "__mem_region_end(&__mem_region);\n";
+        for (const auto &var : functionInitializedVars[functionName])
+            analysisCode << "__mem_time(" << getProfileRef(var) << ", &__mem_region);\n";
+        if (!config.accumulate)
+            analysisCode << "__mem_print_region(&__mem_region);\n";
+    }
+
+    if (config.accumulate) {
+        // 累积模式只在报告函数退出时输出当前线程的累积结果，其余情况在程序退出时统一输出
+        const auto &reportFuncs = config.reportFunctions;
+        if (std::find(reportFuncs.begin(), reportFuncs.end(), functionName) != reportFuncs.end())
+            analysisCode << "__mem_report();\n";
+        return analysisCode.str();
+    }
+
     // 只分析在该函数中已初始化的变量
     auto &initializedVars = functionInitializedVars[functionName];
+    if (config.loopSites && config.reduceThreads == 0 && !initializedVars.empty()) {
+        // 区分循环时统一交给运行时，按访问次数从多到少输出
+        const char *separator = "";
+        analysisCode << "{\nmem_profile_t* __mem_profs[] = {";
+        for (const auto &var : initializedVars) {
+            analysisCode << separator << "&__" << var << "_prof";
+            separator = ", ";
+        }
+        analysisCode << "};\n__mem_report_profiles(__mem_profs, " << initializedVars.size() << ");\n}\n";
+        return analysisCode.str();
+    }
     for (const auto &var : initializedVars) {
+        if (config.reduceThreads > 0) {
+            // 归约到共享结果，由最后到达的线程统一输出
+            analysisCode << "__mem_reduce(&" << getSharedProfileName(functionName, var) << ", &__" << var
+                         << "_prof);\n";
+            continue;
+        }
         analysisCode << "__mem_analyze(&__" << var << "_prof);\n";
         analysisCode << "__mem_print_analysis(&__" << var << "_prof);\n";
     }
@@ -213,6 +332,27 @@ std::string MemoryInstrumentationVisitor::generateAnalysisCode(const std::string
     return analysisCode.str();
 }
 
+std::string MemoryInstrumentationVisitor::getSharedProfileName(const std::string &functionName,
+                                                               const std::string &varName)
+{
+    return "__mem_shared_" + functionName + "_" + varName;
+}
+
+void MemoryInstrumentationVisitor::insertSharedProfiles(const clang::FunctionDecl *FD)
+{
+    std::string FuncName = FD->getNameAsString();
+    const auto &initializedVars = functionInitializedVars[FuncName];
+    clang::SourceLocation Loc = FD->getBeginLoc();
+    if (initializedVars.empty() || !isInMainFile(Loc))
+        return;
+
+    std::string Decls;
+    for (const auto &var : initializedVars) {
+        Decls += "static MEM_SHARED mem_shared_profile_t " + getSharedProfileName(FuncName, var) + ";\n";
+    }
+    rewriter.InsertText(Loc, Decls + "\n", /*InsertAfter=*/false);
+}
+
 std::string MemoryInstrumentationVisitor::getSourceText(const clang::Stmt *stmt) const
 {
     clang::SourceManager &SM = rewriter.getSourceMgr();
@@ -298,17 +438,134 @@ bool MemoryInstrumentationVisitor::TraverseFunctionDecl(clang::FunctionDecl *FD)
     if (shouldInstrumentFunction()) {
         functionVars[currentFunctionName].clear();
     }
+    if (config.loopSites && shouldInstrumentFunction()) {
+        collectLoopSites(FD);
+    }
 
     // 正常遍历函数
     bool result = clang::RecursiveASTVisitor<MemoryInstrumentationVisitor>::TraverseFunctionDecl(FD);
 
+    // 遍历结束后才知道函数中插桩了哪些变量
+    if (config.reduceThreads > 0 && !config.accumulate && shouldInstrumentFunction()) {
+        insertSharedProfiles(FD);
+    }
+
     // 恢复之前的函数名
     currentFunctionName = prevFunction;
     currentFunctionDecl = nullptr;
+    loopSites.clear();
 
     return result;
 }
 
+static bool isLoopStmt(const clang::Stmt *S)
+{
+    return llvm::isa<clang::ForStmt>(S) || llvm::isa<clang::WhileStmt>(S) || llvm::isa<clang::DoStmt>(S);
+}
+
+namespace {
+
+// 记录每个变量引用所在的最内层循环
+class LoopRefCollector : public clang::RecursiveASTVisitor<LoopRefCollector>
+{
+public:
+    std::vector<std::pair<const clang::VarDecl *, const clang::Stmt *>> refs;
+
+    bool dataTraverseStmtPre(clang::Stmt *S)
+    {
+        if (isLoopStmt(S))
+            loops.push_back(S);
+        return true;
+    }
+
+    bool dataTraverseStmtPost(clang::Stmt *S)
+    {
+        if (isLoopStmt(S))
+            loops.pop_back();
+        return true;
+    }
+
+    bool VisitDeclRefExpr(clang::DeclRefExpr *DRE)
+    {
+        if (const auto *VD = llvm::dyn_cast<clang::VarDecl>(DRE->getDecl())) {
+            if (!loops.empty())
+                refs.emplace_back(VD, loops.back());
+        }
+        return true;
+    }
+
+private:
+    std::vector<const clang::Stmt *> loops;
+};
+
+} // namespace
+
+void MemoryInstrumentationVisitor::collectLoopSites(clang::FunctionDecl *FD)
+{
+    LoopRefCollector Collector;
+    Collector.TraverseStmt(FD->getBody());
+
+    const clang::SourceManager &SM = ctx.getSourceManager();
+    std::map<const clang::Stmt *, unsigned> Ids;
+    for (const auto &[VD, Loop] : Collector.refs) {
+        // 声明在循环之内的变量每次迭代重新创建，仍计入变量本身的分析结果
+        if (SM.isPointWithin(VD->getLocation(), Loop->getBeginLoc(), Loop->getEndLoc()))
+            continue;
+        auto &Sites = loopSites[VD->getNameAsString()];
+        if (std::any_of(Sites.begin(), Sites.end(), [&](const LoopSite &Site) { return Site.loop == Loop; }))
+            continue;
+
+        auto [It, Inserted] = Ids.emplace(Loop, loopSiteCount + 1);
+        if (Inserted)
+            loopSiteCount++;
+        LoopSite Site;
+        Site.loop = Loop;
+        Site.id = It->second;
+        Site.line = SM.getExpansionLineNumber(Loop->getBeginLoc());
+        Sites.push_back(Site);
+    }
+}
+
+const clang::Stmt *MemoryInstrumentationVisitor::getEnclosingLoop(const clang::Stmt *S) const
+{
+    auto It = contextStack.rbegin();
+    while (It != contextStack.rend() && It->stmt != S)
+        ++It;
+    for (; It != contextStack.rend(); ++It) {
+        if (It->stmt && isLoopStmt(It->stmt))
+            return It->stmt;
+    }
+    return nullptr;
+}
+
+std::vector<const clang::Stmt *> MemoryInstrumentationVisitor::getLoopAncestors(const clang::Stmt *S) const
+{
+    std::vector<const clang::Stmt *> Ancestors;
+    const StmtContext *Context = findContext(S);
+    bool foundLoop = false;
+    while (Context && Context != contextStack.data()) {
+        const clang::Stmt *Parent = (--Context)->stmt;
+        Ancestors.push_back(Parent);
+        if (foundLoop)
+            break;
+        foundLoop = Parent && isLoopStmt(Parent);
+    }
+    return Ancestors;
+}
+
+std::string MemoryInstrumentationVisitor::getSiteVar(const std::string &VarName, const clang::Stmt *Loop) const
+{
+    auto It = loopSites.find(VarName);
+    if (!config.loopSites || !Loop || It == loopSites.end())
+        return VarName;
+    for (const auto &Site : It->second) {
+        std::string ProfVar = VarName + "_loop" + std::to_string(Site.id);
+        if (Site.loop == Loop && instrumentedVars.count(ProfVar))
+            return ProfVar;
+    }
+    return VarName;
+}
+
 bool MemoryInstrumentationVisitor::VisitFunctionDecl(clang::FunctionDecl *FD)
 {
     if (!FD)
@@ -318,6 +575,15 @@ bool MemoryInstrumentationVisitor::VisitFunctionDecl(clang::FunctionDecl *FD)
     // 处理函数参数,在函数体开始处插入
     if (FD->hasBody() && shouldInstrumentFunction()) {
         insertFuncParamProfiler(FD);
+
+        // 参数的分析器初始化完成后开始计时
+        clang::SourceLocation BodyStart = FD->getBody()->getBeginLoc();
+        if (config.timing && isInMainFile(BodyStart)) {
+            rewriter.InsertText(BodyStart.getLocWithOffset(1),
+                                "\n\tmem_region_t __mem_region;\n\t__mem_region_begin(&__mem_region, \"" +
+                                    currentFunctionName + "\");\n",
+                                true, true);
+        }
     }
     return true;
 }
@@ -370,166 +636,110 @@ bool MemoryInstrumentationVisitor::VisitCompoundStmt(clang::CompoundStmt *CS)
     return true;
 }
 
-// 检查表达式是否在指定的AST子树中
-bool MemoryInstrumentationVisitor::isExpressionInSubtree(const clang::Expr *expr, const clang::Stmt *subtreeRoot) const
+// 控制流语句：条件部分中的访问需要记录在语句之前
+static bool isControlFlowStmt(const clang::Stmt *S)
 {
-    if (!expr || !subtreeRoot)
-        return false;
-        
-    // 如果表达式就是子树根节点
-    if (expr == subtreeRoot)
-        return true;
-        
-    // 使用 DynTypedNode 进行遍历
-    clang::DynTypedNode current = clang::DynTypedNode::create(*expr);
-    
-    while (true) {
-        const auto &parents = ctx.getParentMapContext().getParents(current);
-        if (parents.empty())
-            break;
-            
-        current = parents[0];
-        const clang::Stmt *parentStmt = current.get<clang::Stmt>();
-        
-        if (parentStmt == subtreeRoot) {
-            return true;
-        }
-        
-        // 如果遇到其他控制流语句，停止查找
-        if (parentStmt && (llvm::isa<clang::ForStmt>(parentStmt) ||
-                          llvm::isa<clang::WhileStmt>(parentStmt) ||
-                          llvm::isa<clang::DoStmt>(parentStmt) ||
-                          llvm::isa<clang::IfStmt>(parentStmt) ||
-                          llvm::isa<clang::SwitchStmt>(parentStmt))) {
-            if (parentStmt != subtreeRoot) {
-                break;
-            }
-        }
-    }
-    
+    return llvm::isa<clang::ForStmt>(S) || llvm::isa<clang::WhileStmt>(S) || llvm::isa<clang::DoStmt>(S) ||
+           llvm::isa<clang::IfStmt>(S) || llvm::isa<clang::SwitchStmt>(S);
+}
+
+// 判断Child是否为Parent的条件/初始化部分
+static bool isConditionChild(const clang::Stmt *Parent, const clang::Stmt *Child)
+{
+    if (const auto *forStmt = llvm::dyn_cast<clang::ForStmt>(Parent))
+        return Child == forStmt->getInit() || Child == forStmt->getCond() || Child == forStmt->getInc();
+    if (const auto *whileStmt = llvm::dyn_cast<clang::WhileStmt>(Parent))
+        return Child == whileStmt->getCond();
+    if (const auto *doStmt = llvm::dyn_cast<clang::DoStmt>(Parent))
+        return Child == doStmt->getCond();
+    if (const auto *ifStmt = llvm::dyn_cast<clang::IfStmt>(Parent))
+        return Child == ifStmt->getCond();
+    if (const auto *switchStmt = llvm::dyn_cast<clang::SwitchStmt>(Parent))
+        return Child == switchStmt->getCond();
+    if (const auto *caseStmt = llvm::dyn_cast<clang::CaseStmt>(Parent))
+        return Child == caseStmt->getLHS() || Child == caseStmt->getRHS();
     return false;
 }
 
-// 检查表达式是否在控制流语句的条件/初始化部分（通用解决方案）
-bool MemoryInstrumentationVisitor::isInControlFlowCondition(const clang::Expr *E) const
+bool MemoryInstrumentationVisitor::dataTraverseStmtPre(clang::Stmt *S)
 {
-    // 使用 DynTypedNode 来处理 Stmt 和 Decl 的混合结构
-    clang::DynTypedNode current = clang::DynTypedNode::create(*E);
-    
-    while (true) {
-        const auto &parents = ctx.getParentMapContext().getParents(current);
-        if (parents.empty())
-            break;
-            
-        current = parents[0];
-        
-        // 尝试获取 Stmt 类型的父节点
-        const clang::Stmt *parentStmt = current.get<clang::Stmt>();
-        if (!parentStmt) {
-            // 如果不是 Stmt，继续向上查找
-            continue;
-        }
-            
-        // 检查各种控制流语句的条件部分
-        if (const auto *forStmt = llvm::dyn_cast<clang::ForStmt>(parentStmt)) {
-            // 检查是否在 init、cond 或 inc 的子树中
-            if (isExpressionInSubtree(E, forStmt->getInit()) ||
-                isExpressionInSubtree(E, forStmt->getCond()) ||
-                isExpressionInSubtree(E, forStmt->getInc())) {
-                return true;
-            }
-            if (isExpressionInSubtree(E, forStmt->getBody())) {
-                break;
-            }
-        } else if (const auto *whileStmt = llvm::dyn_cast<clang::WhileStmt>(parentStmt)) {
-            // while循环的条件部分
-            if (isExpressionInSubtree(E, whileStmt->getCond())) {
-                return true;
-            }
-            if (isExpressionInSubtree(E, whileStmt->getBody())) {
-                break;
-            }
-        } else if (const auto *doStmt = llvm::dyn_cast<clang::DoStmt>(parentStmt)) {
-            // do-while循环的条件部分
-            if (isExpressionInSubtree(E, doStmt->getCond())) {
-                return true;
-            }
-            if (isExpressionInSubtree(E, doStmt->getBody())) {
-                break;
-            }
-        } else if (const auto *ifStmt = llvm::dyn_cast<clang::IfStmt>(parentStmt)) {
-            // if语句的条件部分
-            if (isExpressionInSubtree(E, ifStmt->getCond())) {
-                return true;
-            }
-            if (isExpressionInSubtree(E, ifStmt->getThen()) || 
-                isExpressionInSubtree(E, ifStmt->getElse())) {
-                break;
-            }
-        } else if (const auto *switchStmt = llvm::dyn_cast<clang::SwitchStmt>(parentStmt)) {
-            // switch语句的条件部分
-            if (isExpressionInSubtree(E, switchStmt->getCond())) {
-                return true;
-            }
-            if (isExpressionInSubtree(E, switchStmt->getBody())) {
-                break;
-            }
-        } else if (const auto *caseStmt = llvm::dyn_cast<clang::CaseStmt>(parentStmt)) {
-            // case语句的值部分
-            if (isExpressionInSubtree(E, caseStmt->getLHS()) || 
-                isExpressionInSubtree(E, caseStmt->getRHS())) {
-                return true;
-            }
-            if (isExpressionInSubtree(E, caseStmt->getSubStmt())) {
-                break;
-            }
-        } else if (llvm::isa<clang::CompoundStmt>(parentStmt)) {
-            // 到达复合语句，说明表达式在语句体内，不在条件部分
-            break;
-        }
+    StmtContext Context;
+    Context.stmt = S;
+    bool isCompound = llvm::isa<clang::CompoundStmt>(S);
+    bool isControl = isControlFlowStmt(S);
+
+    if (contextStack.empty()) {
+        Context.containingStmt = S;
+        Context.outermostControl = isControl ? S : nullptr;
+        Context.hasCompound = isCompound;
+        contextStack.push_back(Context);
+        return true;
     }
-    
-    return false;
+
+    const StmtContext &Parent = contextStack.back();
+    const clang::Stmt *ParentStmt = Parent.stmt;
+
+    // 完整语句：父节点为复合语句或控制流语句时即为自身，声明边界同样截止
+    if (!ParentStmt || llvm::isa<clang::CompoundStmt>(ParentStmt) || isControlFlowStmt(ParentStmt))
+        Context.containingStmt = S;
+    else
+        Context.containingStmt = Parent.containingStmt;
+
+    // 最近的控制流语句（或case）决定是否处于条件部分，遇到复合语句为止
+    if (ParentStmt && (isControlFlowStmt(ParentStmt) || llvm::isa<clang::CaseStmt>(ParentStmt)))
+        Context.inCondition = isConditionChild(ParentStmt, S);
+    else if (ParentStmt && llvm::isa<clang::CompoundStmt>(ParentStmt))
+        Context.inCondition = false;
+    else
+        Context.inCondition = Parent.inCondition;
+
+    // 条件中的访问插入到最近的复合语句之下最外层的控制流语句之前
+    Context.hasCompound = isCompound || Parent.hasCompound;
+    if (isCompound) {
+        Context.outermostControl = nullptr;
+        Context.conditionAnchor = Parent.conditionAnchor;
+    } else if (isControl) {
+        Context.outermostControl = Parent.outermostControl ? Parent.outermostControl : S;
+        Context.conditionAnchor =
+            Parent.hasCompound ? (Parent.outermostControl ? Parent.outermostControl : S) : nullptr;
+    } else {
+        Context.outermostControl = Parent.outermostControl;
+        Context.conditionAnchor = Parent.conditionAnchor;
+    }
+
+    contextStack.push_back(Context);
+    return true;
 }
 
-// 找到合适的插入位置（控制流语句之前的位置）
-clang::SourceLocation MemoryInstrumentationVisitor::findAppropriateInsertLocation(const clang::Expr *E) const
+bool MemoryInstrumentationVisitor::dataTraverseStmtPost(clang::Stmt *S)
 {
-    // 使用与isInControlFlowCondition相同的DynTypedNode遍历方法
-    clang::DynTypedNode current = clang::DynTypedNode::create(*E);
-    const clang::Stmt *controlFlowStmt = nullptr;
-    
-    while (true) {
-        const auto &parents = ctx.getParentMapContext().getParents(current);
-        if (parents.empty())
-            break;
-            
-        current = parents[0];
-        
-        // 尝试获取 Stmt 类型的父节点
-        const clang::Stmt *parentStmt = current.get<clang::Stmt>();
-        if (!parentStmt) {
-            // 如果不是 Stmt，继续向上查找
-            continue;
-        }
-        
-        // 检查是否是控制流语句
-        if (llvm::isa<clang::ForStmt>(parentStmt) || 
-            llvm::isa<clang::WhileStmt>(parentStmt) ||
-            llvm::isa<clang::DoStmt>(parentStmt) ||
-            llvm::isa<clang::IfStmt>(parentStmt) ||
-            llvm::isa<clang::SwitchStmt>(parentStmt)) {
-            controlFlowStmt = parentStmt;
-        }
-        
-        // 如果到达复合语句，检查是否找到了控制流语句
-        if (llvm::isa<clang::CompoundStmt>(parentStmt) && controlFlowStmt) {
-            // 返回控制流语句的开始位置
-            return controlFlowStmt->getBeginLoc();
-        }
+    contextStack.pop_back();
+    return true;
+}
+
+bool MemoryInstrumentationVisitor::TraverseDecl(clang::Decl *D)
+{
+    // 顶层声明没有语句上下文
+    if (contextStack.empty())
+        return clang::RecursiveASTVisitor<MemoryInstrumentationVisitor>::TraverseDecl(D);
+
+    // 声明边界继承外层语句的条件信息，但截断完整语句的查找
+    StmtContext Boundary = contextStack.back();
+    Boundary.stmt = nullptr;
+    contextStack.push_back(Boundary);
+    bool result = clang::RecursiveASTVisitor<MemoryInstrumentationVisitor>::TraverseDecl(D);
+    contextStack.pop_back();
+    return result;
+}
+
+const MemoryInstrumentationVisitor::StmtContext *
+MemoryInstrumentationVisitor::findContext(const clang::Stmt *S) const
+{
+    for (auto It = contextStack.rbegin(); It != contextStack.rend(); ++It) {
+        if (It->stmt == S)
+            return &*It;
     }
-    
-    return clang::SourceLocation(); // 无效位置
+    return nullptr;
 }
 
 // 插入内存访问记录代码
@@ -543,46 +753,29 @@ bool MemoryInstrumentationVisitor::insertMemoryAccessRecord(const clang::Expr *E
         return true;
 
     const auto &SM = ctx.getSourceManager();
+    const StmtContext *Context = findContext(Expr);
+    if (!Context)
+        return false;
     
     // 检查表达式是否在控制流语句的条件部分
-    if (isInControlFlowCondition(Expr)) {
+    if (Context->inCondition) {
         // 如果在控制流条件部分，将记录代码插入到控制流语句之前
-        clang::SourceLocation insertLoc = findAppropriateInsertLocation(Expr);
+        clang::SourceLocation insertLoc =
+            Context->conditionAnchor ? Context->conditionAnchor->getBeginLoc() : clang::SourceLocation();
         if (insertLoc.isValid() && isInMainFile(insertLoc)) {
             // 获取适当的缩进
             unsigned indent = getIndentation(insertLoc);
             std::string indentStr(indent, ' ');
             
             // 生成记录代码，插入到控制流语句之前
-            std::string RecordCode = indentStr + "__mem_record(&__" + VarName + "_prof, (void*)&(" + AccessExpr + "));\n";
+            std::string RecordCode = indentStr + generateRecordCall(Expr, VarName, AccessExpr) + "\n";
             
             rewriter.InsertText(insertLoc, RecordCode, /*InsertAfter=*/false);
             return true;
         }
     } else {
-        // 如果不在控制流条件部分，使用原来的逻辑
-        // 找到包含此表达式的最内层语句
-        const clang::Stmt *ContainingStmt = Expr;
-
-        // 向上查找直到找到一个完整的语句
-        while (true) {
-            const auto &parents = ctx.getParentMapContext().getParents(*ContainingStmt);
-            if (parents.empty())
-                break;
-
-            const clang::Stmt *Parent = parents[0].get<clang::Stmt>();
-            if (!Parent)
-                break;
-
-            // 检查是否找到了一个完整的语句
-            if (llvm::isa<clang::CompoundStmt>(Parent) || llvm::isa<clang::IfStmt>(Parent) ||
-                llvm::isa<clang::ForStmt>(Parent) || llvm::isa<clang::WhileStmt>(Parent) ||
-                llvm::isa<clang::DoStmt>(Parent) || llvm::isa<clang::SwitchStmt>(Parent)) {
-                break;
-            }
-
-            ContainingStmt = Parent;
-        }
+        // 如果不在控制流条件部分，在包含此表达式的完整语句之后记录
+        const clang::Stmt *ContainingStmt = Context->containingStmt;
 
         // 获取语句的结束位置
         clang::SourceLocation StmtEndLoc = ContainingStmt->getEndLoc();
@@ -604,8 +797,7 @@ bool MemoryInstrumentationVisitor::insertMemoryAccessRecord(const clang::Expr *E
             std::string indentStr(indent, ' ');
 
             // 生成记录代码
-            std::string RecordCode =
-                "\n" + indentStr + "__mem_record(&__" + VarName + "_prof, (void*)&(" + AccessExpr + "));";
+            std::string RecordCode = "\n" + indentStr + generateRecordCall(Expr, VarName, AccessExpr);
 
             rewriter.InsertText(InsertLoc, RecordCode, /*InsertAfter=*/true);
             return true;
@@ -615,17 +807,133 @@ bool MemoryInstrumentationVisitor::insertMemoryAccessRecord(const clang::Expr *E
     return false;
 }
 
-// 数组下标访问
+// 区分读写或统计线程间共享时附带访问类别，分维统计时多维数组访问随后记录各维下标
+std::string MemoryInstrumentationVisitor::generateRecordCall(const clang::Expr *E, const std::string &VarName,
+                                                             const std::string &AccessExpr) const
+{
+    std::string SiteVar = getSiteVar(VarName, getEnclosingLoop(E));
+    std::string Args = getProfileRef(SiteVar) + ", (void*)&(" + AccessExpr + ")";
+    bool Kinds = config.loadStore || config.sharing;
+    std::string Call = Kinds ? "__mem_record_kind(" + Args + ", " + getAccessKind(E) + ");"
+                             : "__mem_record(" + Args + ");";
+
+    std::vector<const clang::Expr *> Subscripts;
+    const auto *ASE = llvm::dyn_cast<clang::ArraySubscriptExpr>(E);
+    if (!config.dimStrides || !ASE || !getSubscriptBase(ASE, Subscripts))
+        return Call;
+    std::vector<std::string> Indices;
+    for (const auto *Index : Subscripts)
+        Indices.push_back(getSourceText(Index));
+    std::string IndexCall = generateIndexCall(SiteVar, Indices);
+    return IndexCall.empty() ? Call : Call + " " + IndexCall;
+}
+
+std::string MemoryInstrumentationVisitor::generateIndexCall(const std::string &VarName,
+                                                            const std::vector<std::string> &Indices) const
+{
+    if (Indices.size() < 2 || Indices.size() > MemoryCodeGenerator::MAX_DIMS)
+        return "";
+    std::string Call = "__mem_index(" + getProfileRef(VarName) + ", " + std::to_string(Indices.size());
+    for (unsigned i = 0; i < MemoryCodeGenerator::MAX_DIMS; i++)
+        Call += i < Indices.size() ? ", (long)(" + Indices[i] + ")" : ", 0";
+    return Call + ");";
+}
+
+// 沿语句上下文栈向上查看访问所在的左值/右值上下文：作为赋值左侧时为写，作为复合赋值左侧或
+// 自增自减的操作数时为读改写，其余情况（包括取地址和传引用）按读处理。括号、结构体成员和
+// 多维数组的外层下标不改变类别，继续向上查看
+std::string MemoryInstrumentationVisitor::getAccessKind(const clang::Expr *E) const
+{
+    const StmtContext *Context = findContext(E);
+    const clang::Stmt *Current = E;
+    while (Context && Context != contextStack.data()) {
+        const clang::Stmt *Parent = (--Context)->stmt;
+        if (!Parent)
+            break;
+        if (llvm::isa<clang::ParenExpr>(Parent)) {
+            Current = Parent;
+        } else if (const auto *ME = llvm::dyn_cast<clang::MemberExpr>(Parent)) {
+            if (ME->isArrow())
+                break;
+            Current = Parent;
+        } else if (const auto *Cast = llvm::dyn_cast<clang::ImplicitCastExpr>(Parent)) {
+            if (Cast->getCastKind() != clang::CK_ArrayToPointerDecay)
+                break;
+            Current = Parent;
+        } else if (const auto *Outer = llvm::dyn_cast<clang::ArraySubscriptExpr>(Parent)) {
+            if (Outer->getBase() != Current)
+                break;
+            Current = Parent;
+        } else if (const auto *BO = llvm::dyn_cast<clang::BinaryOperator>(Parent)) {
+            if (BO->isAssignmentOp() && BO->getLHS() == Current)
+                return BO->getOpcode() == clang::BO_Assign ? "MEM_STORE" : "MEM_UPDATE";
+            break;
+        } else if (const auto *UO = llvm::dyn_cast<clang::UnaryOperator>(Parent)) {
+            if (UO->isIncrementDecrementOp())
+                return "MEM_UPDATE";
+            break;
+        } else {
+            break;
+        }
+    }
+    return "MEM_LOAD";
+}
+
+// 仿射循环访问摘要
+bool MemoryInstrumentationVisitor::insertAffineSummary(const clang::ArraySubscriptExpr *ASE,
+                                                       const AffineAccess &Access, const std::string &VarName) const
+{
+    clang::SourceLocation LoopLoc = Access.loop->getBeginLoc();
+    if (!isInMainFile(LoopLoc))
+        return false;
+
+    std::string indentStr(getIndentation(LoopLoc), ' ');
+    std::string SiteVar = getSiteVar(VarName, Access.loop);
+    std::string Element = VarName;
+    for (const auto &Index : Access.firstIndices)
+        Element += "[" + Index + "]";
+    std::string Args = getProfileRef(SiteVar) + ", (void*)&(" + Element + "), " + std::to_string(Access.stride) +
+                       ", " + Access.tripCount;
+    bool Kinds = config.loadStore || config.sharing;
+    std::string SummaryCode = (Kinds ? "__mem_record_affine_kind(" + Args + ", " + getAccessKind(ASE)
+                                     : "__mem_record_affine(" + Args) +
+                              ");\n" + indentStr;
+
+    // 多维数组各维的第一次迭代下标与每次迭代的变化
+    size_t Dims = Access.firstIndices.size();
+    if (config.dimStrides && Dims > 1 && Dims <= MemoryCodeGenerator::MAX_DIMS) {
+        SummaryCode += "__mem_index_affine(" + getProfileRef(SiteVar) + ", " + std::to_string(Dims);
+        for (unsigned i = 0; i < MemoryCodeGenerator::MAX_DIMS; i++)
+            SummaryCode += i < Dims ? ", (long)(" + Access.firstIndices[i] + ")" : ", 0";
+        for (unsigned i = 0; i < MemoryCodeGenerator::MAX_DIMS; i++)
+            SummaryCode += i < Dims ? ", " + std::to_string(Access.indexSteps[i]) : ", 0";
+        SummaryCode += ", " + Access.tripCount + ");\n" + indentStr;
+    }
+
+    rewriter.InsertText(LoopLoc, SummaryCode, /*InsertAfter=*/false);
+    return true;
+}
+
+// 数组下标访问。多维数组只在最外层下标处记录一次完整元素的访问，
+// 结果仍为数组的内层下标只是地址计算，不访问内存
 bool MemoryInstrumentationVisitor::handleArraySubscriptExpr(const clang::ArraySubscriptExpr *ASE) const
 {
-    if (!ASE)
+    if (!ASE || ASE->getType()->isArrayType())
         return true;
 
-    const clang::Expr *Base = ASE->getBase()->IgnoreImplicit();
-    if (auto *DRE = llvm::dyn_cast<clang::DeclRefExpr>(Base)) {
+    std::vector<const clang::Expr *> Indices;
+    if (auto *DRE = getSubscriptBase(ASE, Indices)) {
         std::string ArrayName = DRE->getNameInfo().getAsString();
         std::string AccessExpr = getSourceText(ASE);
 
+        // 循环中的仿射访问只在循环前记录一次摘要；重用距离需要逐次访问的地址，此时不做摘要
+        if (config.affineSummary && !config.reuseDistance && shouldInstrumentFunction() && instrumentedVars.count(ArrayName)) {
+            if (auto Affine = analyzeAffineAccess(ASE, getLoopAncestors(ASE), ctx)) {
+                if (insertAffineSummary(ASE, *Affine, ArrayName))
+                    return true;
+            }
+        }
+
         return insertMemoryAccessRecord(ASE, ArrayName, AccessExpr);
     }
     return true;
@@ -711,22 +1019,26 @@ bool MemoryInstrumentationVisitor::VisitMemberExpr(clang::MemberExpr *ME) const
 
 void MemoryInstrumentationConsumer::HandleTranslationUnit(clang::ASTContext &Context)
 {
-    MemoryInstrumentationVisitor Visitor(rewriter, Context, includes, targetFunctions);
+    MemoryInstrumentationVisitor Visitor(rewriter, Context, includes, targetFunctions, config, log);
     Visitor.TraverseDecl(Context.getTranslationUnitDecl());
 
-    // Debug output for initialized variables
-    llvm::outs() << "\nInstrumented Variables:\n";
+    // Debug output for initialized variables，按名字排序保证输出稳定
+    log << "\nInstrumented Variables:\n";
     const auto &initializedVars = Visitor.getInitializedVars();
-
+    std::map<std::string, std::set<std::string>> sortedVars;
     for (const auto &funcPair : initializedVars) {
+        sortedVars[funcPair.first].insert(funcPair.second.begin(), funcPair.second.end());
+    }
+
+    for (const auto &funcPair : sortedVars) {
         if (!funcPair.first.empty() && !funcPair.second.empty()) {
-            llvm::outs() << funcPair.first << "\n";
+            log << funcPair.first << "\n";
             for (const auto &var : funcPair.second) {
                 if (!var.empty()) {
-                    llvm::outs() << "  - " << var << "\n";
+                    log << "  - " << var << "\n";
                 }
             }
         }
     }
-    llvm::outs() << "\n";
+    log << "\n";
 }
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "../include/ParallelInstrumentation.h"
+#include "../include/CommandLineOptions.h"
+#include "../include/FrontendAction.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Frontend/TextDiagnosticPrinter.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace {
+
+// 单个翻译单元的缓冲输出
+struct UnitResult
+{
+    std::string out;
+    std::string err;
+    int status = 0;
+};
+
+void instrumentUnit(const clang::tooling::CompilationDatabase &compilations, const std::string &file,
+                    const InstrumentationCache *cache, UnitResult &result)
+{
+    llvm::raw_string_ostream out(result.out);
+    llvm::raw_string_ostream err(result.err);
+
+    CacheEntry entry;
+    if (cache && cache->lookup(compilations, file, entry, out))
+        return;
+
+    // 真实文件系统会随ClangTool切换进程的工作目录，各线程需要独立的物理文件系统视图
+    clang::tooling::ClangTool Tool(compilations, {file},
+                                   std::make_shared<clang::PCHContainerOperations>(),
+                                   llvm::vfs::createPhysicalFileSystem());
+    clang::TextDiagnosticPrinter Diagnostics(err, new clang::DiagnosticOptions());
+    Tool.setDiagnosticConsumer(&Diagnostics);
+
+    std::vector<std::string> targetFuncs(TargetFunctions.begin(), TargetFunctions.end());
+    InstrumentationFrontendActionFactory Factory(getProfilerConfig(), targetFuncs, OutputFilename, out, err);
+    result.status = Tool.run(&Factory);
+    if (cache)
+        cache->store(entry, err);
+}
+
+} // namespace
+
+int runParallelInstrumentation(const clang::tooling::CompilationDatabase &compilations,
+                               const std::vector<std::string> &files, unsigned jobs,
+                               const InstrumentationCache *cache)
+{
+    std::vector<UnitResult> results(files.size());
+    std::atomic<size_t> next(0);
+
+    // 工作线程按顺序领取下一个翻译单元，结果写入各自的槽位
+    auto worker = [&]() {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            instrumentUnit(compilations, files[i], cache, results[i]);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    unsigned count = std::min<size_t>(jobs, files.size());
+    for (unsigned i = 0; i < count; i++) {
+        workers.emplace_back(worker);
+    }
+    for (auto &thread : workers) {
+        thread.join();
+    }
+
+    // 按输入顺序输出，保证结果与线程调度无关
+    int status = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        llvm::outs() << "[" << i + 1 << "/" << files.size() << "] " << files[i] << "\n" << results[i].out;
+        llvm::errs() << results[i].err;
+        // 出错优先于跳过
+        if (status == 0 || results[i].status == 1)
+            status = results[i].status;
+    }
+    return status;
+}
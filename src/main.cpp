@@ -1,29 +1,136 @@
 #include "../include/CommandLineOptions.h"
 #include "../include/FrontendAction.h"
+#include "../include/InstrumentationCache.h"
+#include "../include/ParallelInstrumentation.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Threading.h"
 
 using namespace clang::tooling;
 using namespace llvm;
 using namespace clang;
 
+// 未给出源文件时CommonOptionsParser不会加载编译数据库，
+// 这里按 -p 指定的目录（默认为当前目录）向上查找 compile_commands.json
+static std::unique_ptr<CompilationDatabase> loadCompilationDatabase()
+{
+    std::string BuildPath = ".";
+    auto &Options = cl::getRegisteredOptions();
+    auto It = Options.find("p");
+    if (It != Options.end()) {
+        auto *PathOption = static_cast<cl::opt<std::string> *>(It->second);
+        if (!PathOption->getValue().empty())
+            BuildPath = PathOption->getValue();
+    }
+
+    std::string ErrorMessage;
+    auto Database = CompilationDatabase::autoDetectFromDirectory(BuildPath, ErrorMessage);
+    if (!Database)
+        llvm::errs() << "Error: no source files given and no compilation database found: " << ErrorMessage << "\n";
+    return Database;
+}
+
+// 按当前选项生成单独编译的运行时库源码 mem_profiler.h 与 mem_profiler.c
+static int writeRuntimeLibrary(const std::string &Directory)
+{
+    ProfilerConfig Config = getProfilerConfig();
+    std::pair<const char *, std::string> Files[] = {
+        {"mem_profiler.h", MemoryCodeGenerator::generateRuntimeHeader(Config)},
+        {"mem_profiler.c", MemoryCodeGenerator::generateRuntimeSource(Config)},
+    };
+
+    if (std::error_code EC = llvm::sys::fs::create_directories(Directory)) {
+        llvm::errs() << "Error: Could not create directory " << Directory << ": " << EC.message() << "\n";
+        return 1;
+    }
+    for (const auto &[Name, Code] : Files) {
+        llvm::SmallString<128> Path(Directory);
+        llvm::sys::path::append(Path, Name);
+        std::error_code EC;
+        llvm::raw_fd_ostream OutFile(Path, EC, llvm::sys::fs::OF_None);
+        if (EC) {
+            llvm::errs() << "Error: Could not create output file " << Path << ": " << EC.message() << "\n";
+            return 1;
+        }
+        OutFile << Code;
+        llvm::outs() << "Successfully generated runtime file: " << Path << "\n";
+    }
+    return 0;
+}
+
 int main(int argc, const char **argv)
 {
-    // 解析命令行参数
-    auto ExpectedParser = CommonOptionsParser::create(argc, argv, ToolCategory);
+    // 解析命令行参数，源文件可以省略，此时插桩编译数据库中的全部文件
+    auto ExpectedParser = CommonOptionsParser::create(argc, argv, ToolCategory, cl::ZeroOrMore);
     if (!ExpectedParser) {
         llvm::errs() << ExpectedParser.takeError();
         return 1;
     }
     CommonOptionsParser &OptionsParser = ExpectedParser.get();
-    ClangTool Tool(OptionsParser.getCompilations(), OptionsParser.getSourcePathList());
+    if (!EmitRuntime.empty()) {
+        return writeRuntimeLibrary(EmitRuntime);
+    }
+
+    std::vector<std::string> Sources = OptionsParser.getSourcePathList();
+    std::unique_ptr<CompilationDatabase> Database;
+    const CompilationDatabase *Compilations = nullptr;
+    if (Sources.empty()) {
+        Database = loadCompilationDatabase();
+        if (!Database)
+            return 1;
+        Sources = Database->getAllFiles();
+        Compilations = Database.get();
+    } else {
+        Compilations = &OptionsParser.getCompilations();
+    }
+    if (Sources.empty()) {
+        llvm::errs() << "Error: no source files to instrument\n";
+        return 1;
+    }
+    if (!OutputFilename.empty() && Sources.size() > 1) {
+        llvm::errs() << "Error: -o can only be used with a single source file\n";
+        return 1;
+    }
+    unsigned JobCount = Jobs == 0 ? llvm::hardware_concurrency().compute_thread_count() : Jobs.getValue();
+    std::unique_ptr<InstrumentationCache> Cache;
+    if (!CacheDir.empty()) {
+        Cache = std::make_unique<InstrumentationCache>(CacheDir, argv[0]);
+    }
 
     // 打印工具信息和配置
     llvm::outs() << "MT-3000 Source Code Instrumentation Tool\n";
     llvm::outs() << "======================================\n";
     llvm::outs() << "Mode: Memory Access Instrumentation\n";
+    switch (Backend) {
+    case ProfilerBackend::Device:
+        llvm::outs() << "Backend: MT3000 (hthread)\n";
+        break;
+    case ProfilerBackend::Pthread:
+        llvm::outs() << "Backend: Host (pthreads)\n";
+        break;
+    case ProfilerBackend::OpenMP:
+        llvm::outs() << "Backend: Host (OpenMP)\n";
+        break;
+    }
+    if (SamplePeriod > 1 && SampleBurst < SamplePeriod) {
+        llvm::outs() << "Sampling: " << SampleBurst << " of every " << SamplePeriod << " accesses\n";
+    }
+    if (Timing) {
+        llvm::outs() << "Timing: cycles and bytes per cycle per function\n";
+    }
+    if (Sharing) {
+        llvm::outs() << "Sharing: cache lines compared across threads in merged reports\n";
+    }
+    if (Accumulate) {
+        llvm::outs() << "Profiles: accumulated across calls, reported at exit\n";
+    }
+    if (RuntimeLibrary) {
+        llvm::outs() << "Runtime: mem_profiler.h (separately compiled library)\n";
+    }
     if (!TargetFunctions.empty()) {
         llvm::outs() << "Target Functions:\n";
         for (const auto &func : TargetFunctions) {
@@ -32,9 +139,40 @@ int main(int argc, const char **argv)
     } else {
         llvm::outs() << "Target: All Functions\n";
     }
+    if (JobCount > 1 && Sources.size() > 1) {
+        llvm::outs() << "Jobs: " << JobCount << " (" << Sources.size() << " translation units)\n";
+    }
     // }
     llvm::outs() << "======================================\n";
 
+    // 多个翻译单元时并行插桩
+    if (JobCount > 1 && Sources.size() > 1) {
+        return runParallelInstrumentation(*Compilations, Sources, JobCount, Cache.get());
+    }
+
+    // 缓存命中的文件不再运行前端
+    std::vector<std::string> Misses = Sources;
+    std::vector<CacheEntry> Entries;
+    if (Cache) {
+        Misses.clear();
+        for (const auto &Source : Sources) {
+            CacheEntry Entry;
+            if (!Cache->lookup(*Compilations, Source, Entry, llvm::outs())) {
+                Misses.push_back(Source);
+                Entries.push_back(Entry);
+            }
+        }
+        if (Misses.empty())
+            return 0;
+    }
+
     // 运行工具
-    return Tool.run(std::make_unique<InstrumentationFrontendActionFactory>().get());
+    ClangTool Tool(*Compilations, Misses);
+    std::vector<std::string> TargetFuncs(TargetFunctions.begin(), TargetFunctions.end());
+    InstrumentationFrontendActionFactory Factory(getProfilerConfig(), TargetFuncs, OutputFilename);
+    int Status = Tool.run(&Factory);
+    for (const auto &Entry : Entries) {
+        Cache->store(Entry, llvm::errs());
+    }
+    return Status;
 }
\ No newline at end of file